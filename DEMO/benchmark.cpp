@@ -0,0 +1,425 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#include "benchmark.h"
+
+#include "is_mesh.h"
+#include "attributes.h"
+#include "mesh_io.h"
+#include "tetralizer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+using namespace is_mesh;
+
+namespace {
+    
+    /**
+     An ISMesh which makes the topological operations, which are otherwise only available to derived classes, public.
+     */
+    class BenchmarkMesh : public ISMesh<NodeAttributes, EdgeAttributes, FaceAttributes, TetAttributes>
+    {
+    public:
+        BenchmarkMesh(const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels) : ISMesh(points, tets, tet_labels)
+        {
+            
+        }
+        
+        using ISMesh::split;
+        using ISMesh::collapse;
+        using ISMesh::flip_23;
+        using ISMesh::flip_32;
+        using ISMesh::flip_22;
+        using ISMesh::flip_44;
+    };
+    
+    typedef std::chrono::steady_clock clock;
+    
+    /**
+     Discards everything written to std::cout while it exists, for example the output of the validity check in the constructor of ISMesh.
+     */
+    class MuteCout
+    {
+        std::streambuf* buffer;
+    
+    public:
+        MuteCout() : buffer(std::cout.rdbuf(nullptr))
+        {
+            
+        }
+        
+        ~MuteCout()
+        {
+            std::cout.rdbuf(buffer);
+        }
+    };
+    
+    /**
+     Calls f and adds the time it took to seconds.
+     */
+    template<typename Function>
+    void timed(double& seconds, Function f)
+    {
+        clock::time_point start = clock::now();
+        f();
+        std::chrono::duration<double> t = clock::now() - start;
+        seconds += t.count();
+    }
+    
+    /**
+     Selects simplices whose stars do not share any nodes, such that an operation on one of them does not affect the others.
+     */
+    class IndependentSet
+    {
+        std::vector<bool> used;
+    
+    public:
+        /**
+         Adds the star given by its nodes if none of the nodes are used by a star which is already added. Returns whether it is added.
+         */
+        bool add(const SimplexSet<NodeKey>& nids)
+        {
+            for (auto n : nids)
+            {
+                if (static_cast<size_t>(n) < used.size() && used[static_cast<size_t>(n)])
+                {
+                    return false;
+                }
+            }
+            for (auto n : nids)
+            {
+                size_t i = static_cast<size_t>(n);
+                if (i >= used.size())
+                {
+                    used.resize(i + 1, false);
+                }
+                used[i] = true;
+            }
+            return true;
+        }
+    };
+    
+    /**
+     Returns independent interior faces which can be flipped from two to three tetrahedra.
+     */
+    std::vector<FaceKey> flip_23_candidates(BenchmarkMesh& mesh)
+    {
+        std::vector<FaceKey> fids;
+        IndependentSet set;
+        for (auto fit = mesh.faces_begin(); fit != mesh.faces_end(); fit++)
+        {
+            auto tids = mesh.get_tets(fit.key());
+            if (tids.size() == 2 && mesh.get_label(tids[0]) == mesh.get_label(tids[1]))
+            {
+                auto apices = mesh.get_nodes(tids) - mesh.get_nodes(fit.key());
+                if (!mesh.get_edge(apices[0], apices[1]).is_valid() && set.add(mesh.get_nodes(tids)))
+                {
+                    fids.push_back(fit.key());
+                }
+            }
+        }
+        return fids;
+    }
+    
+    /**
+     Returns independent edges which have exactly two faces for which is_flip_face is true, the number of faces given by no_faces and as many
+     tetrahedra as a flip_22 (two) or a flip_44 (four) requires.
+     The two faces of each edge are returned in fids.
+     */
+    template<typename Function>
+    std::vector<EdgeKey> flip_edge_candidates(BenchmarkMesh& mesh, unsigned int no_faces, Function is_flip_face, std::vector<FaceKey>& fids)
+    {
+        std::vector<EdgeKey> eids;
+        IndependentSet set;
+        for (auto eit = mesh.edges_begin(); eit != mesh.edges_end(); eit++)
+        {
+            auto e_fids = mesh.get_faces(eit.key());
+            if (e_fids.size() != no_faces || mesh.get_tets(eit.key()).size() != (no_faces == 3 ? 2 : 4))
+            {
+                continue;
+            }
+            SimplexSet<FaceKey> flip_fids;
+            for (auto f : e_fids)
+            {
+                if (is_flip_face(f))
+                {
+                    flip_fids += f;
+                }
+            }
+            if (flip_fids.size() == 2)
+            {
+                auto new_nids = mesh.get_nodes(flip_fids) - mesh.get_nodes(eit.key());
+                if (!mesh.get_edge(new_nids[0], new_nids[1]).is_valid() && set.add(mesh.get_nodes(mesh.get_tets(eit.key()))))
+                {
+                    eids.push_back(eit.key());
+                    fids.push_back(flip_fids[0]);
+                    fids.push_back(flip_fids[1]);
+                }
+            }
+        }
+        return eids;
+    }
+    
+    /**
+     Returns independent edges which can be split.
+     */
+    std::vector<EdgeKey> split_candidates(BenchmarkMesh& mesh)
+    {
+        std::vector<EdgeKey> eids;
+        IndependentSet set;
+        for (auto eit = mesh.edges_begin(); eit != mesh.edges_end(); eit++)
+        {
+            if (set.add(mesh.get_nodes(mesh.get_tets(eit.key()))))
+            {
+                eids.push_back(eit.key());
+            }
+        }
+        return eids;
+    }
+}
+
+Benchmark::Benchmark(int argc, char** argv)
+{
+    for(int i = 0; i + 1 < argc; ++i)
+    {
+        std::string str(argv[i]);
+        if (str == "model") {
+            models.push_back(argv[i+1]);
+        }
+        else if (str == "grid") {
+            grids.push_back(std::atoi(argv[i+1]));
+        }
+        else if (str == "min_time") {
+            min_time = std::atof(argv[i+1]);
+        }
+        else if (str == "filter") {
+            filter = argv[i+1];
+        }
+    }
+    if (models.empty() && grids.empty())
+    {
+        models = {"blob", "armadillo"};
+        grids = {8, 16, 32};
+    }
+}
+
+void Benchmark::run()
+{
+    std::cout << std::left << std::setw(20) << "Benchmark" << std::setw(16) << "Input" << std::right << std::setw(16) << "Time/op (ns)" << std::setw(16) << "Operations" << std::endl;
+    for (auto& model : models)
+    {
+        std::vector<vec3> points;
+        std::vector<int> tets;
+        std::vector<int> tet_labels;
+        if (!std::ifstream(obj_path + model + extension))
+        {
+            std::cerr << "ERROR: " << obj_path + model + extension << " does not exist." << std::endl;
+            continue;
+        }
+        import_tet_mesh(obj_path + model + extension, points, tets, tet_labels);
+        run(model, points, tets, tet_labels);
+    }
+    for (int size : grids)
+    {
+        std::vector<vec3> points;
+        std::vector<int> tets;
+        std::vector<int> tet_labels;
+        Tetralizer::tetralize(vec3(static_cast<real>(size)), 1., points, tets, tet_labels);
+        for (unsigned int i = 0; i < tet_labels.size(); i++)
+        {
+            vec3 c = 0.25*(points[tets[4*i]] + points[tets[4*i+1]] + points[tets[4*i+2]] + points[tets[4*i+3]]);
+            tet_labels[i] = length(c - vec3(0.5*size)) < 0.3*size ? 1 : 0;
+        }
+        run("grid" + std::to_string(size), points, tets, tet_labels);
+    }
+}
+
+void Benchmark::run(const std::string& input, const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels)
+{
+    measure("construction", input, [&](double& seconds) {
+        MuteCout mute;
+        std::unique_ptr<BenchmarkMesh> mesh;
+        timed(seconds, [&]() { mesh = std::unique_ptr<BenchmarkMesh>(new BenchmarkMesh(points, tets, tet_labels)); });
+        return 1LL;
+    });
+    
+    std::unique_ptr<BenchmarkMesh> mesh_ptr;
+    {
+        MuteCout mute;
+        mesh_ptr = std::unique_ptr<BenchmarkMesh>(new BenchmarkMesh(points, tets, tet_labels));
+    }
+    BenchmarkMesh& mesh = *mesh_ptr;
+    
+    measure("extract_tet_mesh", input, [&](double& seconds) {
+        std::vector<vec3> p;
+        std::vector<int> t, l;
+        timed(seconds, [&]() { mesh.extract_tet_mesh(p, t, l); });
+        return 1LL;
+    });
+    
+    measure("garbage_collect", input, [&](double& seconds) {
+        timed(seconds, [&]() { mesh.garbage_collect(); });
+        return 1LL;
+    });
+    
+    measure("get_tets(node)", input, [&](double& seconds) {
+        long long n = 0;
+        size_t sum = 0;
+        timed(seconds, [&]() {
+            for (auto nit = mesh.nodes_begin(); nit != mesh.nodes_end(); nit++)
+            {
+                sum += mesh.get_tets(nit.key()).size();
+                n++;
+            }
+        });
+        return sum > 0 ? n : 0LL;
+    });
+    
+    std::vector<NodeKey> pairs;
+    for (auto eit = mesh.edges_begin(); eit != mesh.edges_end(); eit++)
+    {
+        auto nids = mesh.get_nodes(eit.key());
+        pairs.push_back(nids[0]);
+        pairs.push_back(nids[1]);
+    }
+    measure("get_edge(node,node)", input, [&](double& seconds) {
+        long long n = 0;
+        timed(seconds, [&]() {
+            for (unsigned int i = 0; i + 1 < pairs.size(); i += 2)
+            {
+                n += mesh.get_edge(pairs[i], pairs[i+1]).is_valid();
+            }
+        });
+        return n;
+    });
+    
+    // Splits the edges, collapses the new edges in reverse order and returns the number of splits. The splits and/or the collapses are timed.
+    auto split_collapse = [&](double& seconds, bool time_split, bool time_collapse) {
+        std::vector<EdgeKey> eids = split_candidates(mesh);
+        std::vector<NodeKey> old_nids;
+        auto splits = [&]() {
+            for (auto e : eids)
+            {
+                auto nids = mesh.get_nodes(e);
+                vec3 p = 0.5*(mesh.get_pos(nids[0]) + mesh.get_pos(nids[1]));
+                mesh.split(e, p, p);
+                old_nids.push_back(nids[0]);
+            }
+        };
+        auto collapses = [&]() {
+            for (int i = static_cast<int>(eids.size()) - 1; i >= 0; i--)
+            {
+                mesh.collapse(eids[i], old_nids[i], 0.);
+            }
+        };
+        if (time_split) timed(seconds, splits); else splits();
+        if (time_collapse) timed(seconds, collapses); else collapses();
+        mesh.garbage_collect();
+        return static_cast<long long>(eids.size());
+    };
+    measure("split", input, [&](double& seconds) { return split_collapse(seconds, true, false); });
+    measure("collapse", input, [&](double& seconds) { return split_collapse(seconds, false, true); });
+    
+    // Flips faces from two to three tetrahedra and back and returns the number of flips in each direction.
+    auto flip_23_32 = [&](double& seconds, bool time_23, bool time_32) {
+        std::vector<FaceKey> fids = flip_23_candidates(mesh);
+        std::vector<EdgeKey> eids;
+        auto flips_23 = [&]() {
+            for (auto f : fids)
+            {
+                eids.push_back(mesh.flip_23(f));
+            }
+        };
+        auto flips_32 = [&]() {
+            for (auto e : eids)
+            {
+                mesh.flip_32(e);
+            }
+        };
+        if (time_23) timed(seconds, flips_23); else flips_23();
+        if (time_32) timed(seconds, flips_32); else flips_32();
+        mesh.garbage_collect();
+        return static_cast<long long>(fids.size());
+    };
+    measure("flip_23", input, [&](double& seconds) { return flip_23_32(seconds, true, false); });
+    measure("flip_32", input, [&](double& seconds) { return flip_23_32(seconds, false, true); });
+    
+    // Flips the edges twice, which restores the mesh, and returns the number of flips.
+    auto flip_edges = [&](double& seconds, unsigned int no_faces, const std::function<bool(const FaceKey&)>& is_flip_face) {
+        std::vector<FaceKey> fids;
+        std::vector<EdgeKey> eids = flip_edge_candidates(mesh, no_faces, is_flip_face, fids);
+        timed(seconds, [&]() {
+            for (unsigned int i = 0; i < eids.size(); i++)
+            {
+                if (no_faces == 3)
+                {
+                    mesh.flip_22(fids[2*i], fids[2*i+1]);
+                }
+                else {
+                    mesh.flip_44(fids[2*i], fids[2*i+1]);
+                }
+            }
+        });
+        for (unsigned int i = 0; i < eids.size(); i++)
+        {
+            if (no_faces == 3)
+            {
+                mesh.flip_22(fids[2*i], fids[2*i+1]);
+            }
+            else {
+                mesh.flip_44(fids[2*i], fids[2*i+1]);
+            }
+        }
+        mesh.garbage_collect();
+        return static_cast<long long>(eids.size());
+    };
+    measure("flip_22", input, [&](double& seconds) {
+        return flip_edges(seconds, 3, [&](const FaceKey& f) { return mesh.get(f).is_boundary(); });
+    });
+    measure("flip_44", input, [&](double& seconds) {
+        return flip_edges(seconds, 4, [&](const FaceKey& f) { return mesh.get(f).is_interface(); });
+    });
+}
+
+void Benchmark::measure(const std::string& name, const std::string& input, const std::function<long long(double& seconds)>& body)
+{
+    if (name.find(filter) == std::string::npos)
+    {
+        return;
+    }
+    double seconds = 0.;
+    long long operations = 0;
+    while (seconds < min_time)
+    {
+        long long n = body(seconds);
+        if (n == 0)
+        {
+            break;
+        }
+        operations += n;
+    }
+    std::cout << std::left << std::setw(20) << name << std::setw(16) << input << std::right << std::setw(16);
+    if (operations == 0)
+    {
+        std::cout << "no candidates" << std::endl;
+    }
+    else {
+        std::cout << std::fixed << std::setprecision(1) << 1e9*seconds/operations << std::setw(16) << operations << std::endl;
+    }
+}
@@ -0,0 +1,64 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include "util.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ Measures the throughput of the topological operations of is_mesh (splits, collapses, flips, adjacency queries, garbage collection, construction and extraction) on the .dsc models in the data folder and on tetralized grids of increasing size, in which a ball is labelled as the object. Each benchmark is repeated until it has run for at least min_time seconds and the average time per operation is reported. The operations which change the mesh are applied to sets of simplices which do not share any tetrahedra and are undone afterwards, so the mesh is the same in each repetition. Start the DEMO with the argument benchmark, for example
+ DEMO benchmark model armadillo grid 24 min_time 1 filter flip
+ The arguments model and grid can be repeated. By default, the blob and armadillo models and grids of size 8, 16 and 32 are used.
+ */
+class Benchmark
+{
+    std::vector<std::string> models;
+    std::vector<int> grids;
+    real min_time = 0.5;
+    std::string filter;
+
+#ifdef _WIN32
+    const std::string obj_path = "data\\";
+#else
+    const std::string obj_path = "./data/";
+#endif
+    const std::string extension = ".dsc";
+
+public:
+    
+    Benchmark(int argc, char** argv);
+    
+    /**
+     Runs all benchmarks on all inputs and prints a line for each to std::cout.
+     */
+    void run();
+
+private:
+    
+    /**
+     Runs all benchmarks on the tetrahedral mesh given by points, tets and tet_labels.
+     */
+    void run(const std::string& input, const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels);
+    
+    /**
+     Calls body repeatedly until the time it reports has reached min_time and prints the average time per operation. The body adds the time spent in the measured part of each repetition to seconds, so that preparations are excluded, and returns the number of operations performed. Benchmarks whose name does not contain the filter are skipped.
+     */
+    void measure(const std::string& name, const std::string& input, const std::function<long long(double& seconds)>& body);
+};
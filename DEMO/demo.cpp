@@ -15,9 +15,29 @@
 //  See licence.txt for a copy of the GNU General Public License.
 
 #include "user_interface.h"
+#include "headless.h"
+#include "benchmark.h"
 
 int main(int argc, char** argv)
 {
+    for(int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "benchmark") {
+            Benchmark benchmark(argc, argv);
+            benchmark.run();
+            return 0;
+        }
+    }
+#ifdef DSC_HEADLESS
+    for(int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "headless") {
+            Headless headless(argc, argv);
+            headless.run();
+            return 0;
+        }
+    }
+#endif
     UI ui(argc, argv);
     glutMainLoop();
     return 0;
@@ -22,61 +22,102 @@ Painter::GLObject::GLObject(GLuint _shader, const CGLA::Vec4f& ambient_mat_, con
     glGenVertexArrays(1, &array_id);
     glBindVertexArray(array_id);
     
-    glGenBuffers(1, &buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+    glGenBuffers(1, &vertex_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+    glGenBuffers(1, &index_buffer_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
     
     // Initialize shader attributes
     position_att = glGetAttribLocation(shader, "position");
     if (position_att == NULL_LOCATION) {
         std::cerr << "Shader did not contain the 'position' attribute." << std::endl;
     }
+    glEnableVertexAttribArray(position_att);
+    glVertexAttribPointer(position_att, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (const GLvoid *)0);
+    
+    // The flat shader computes the normals of the faces itself and has no 'vector' attribute.
     vector_att = glGetAttribLocation(shader, "vector");
-    if (vector_att == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'vector' attribute." << std::endl;
+    if (vector_att != NULL_LOCATION) {
+        glEnableVertexAttribArray(vector_att);
+        glVertexAttribPointer(vector_att, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (const GLvoid *)(3*sizeof(float)));
     }
     
-    glEnableVertexAttribArray(position_att);
-    glEnableVertexAttribArray(vector_att);
+    // Initialize shader uniforms
+    ambient_uniform = get_uniform_location(shader, "ambientMat");
+    diffuse_uniform = get_uniform_location(shader, "diffuseMat");
+    specular_uniform = get_uniform_location(shader, "specMat");
     check_gl_error();
 }
 
-void Painter::GLObject::add_data(std::vector<vec3> _data)
+template<typename T>
+void Painter::GLObject::upload(GLenum target, const std::vector<T>& data, std::vector<T>& uploaded, size_t& capacity)
 {
-    data = std::vector<vec3>(_data);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vec3)*data.size(), &data[0], GL_STATIC_DRAW);
+    if(data.size() > capacity)
+    {
+        // Leaves room for the data to grow before the buffer is reallocated.
+        capacity = data.size() + data.size()/2;
+        glBufferData(target, sizeof(T)*capacity, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(target, 0, sizeof(T)*data.size(), data.data());
+    }
+    else {
+        auto is_changed = [&](size_t begin)
+        {
+            size_t end = std::min<size_t>(begin + BLOCK_SIZE, data.size());
+            return end > uploaded.size() || !std::equal(data.begin() + begin, data.begin() + end, uploaded.begin() + begin);
+        };
+        
+        // Uploads each run of consecutive changed blocks.
+        size_t i = 0;
+        while (i < data.size())
+        {
+            size_t begin = i;
+            while (i < data.size() && is_changed(i))
+            {
+                i = std::min<size_t>(i + BLOCK_SIZE, data.size());
+            }
+            if(i > begin)
+            {
+                glBufferSubData(target, sizeof(T)*begin, sizeof(T)*(i - begin), &data[begin]);
+            }
+            else {
+                i = std::min<size_t>(i + BLOCK_SIZE, data.size());
+            }
+        }
+    }
+    uploaded = data;
+}
+
+void Painter::GLObject::add_data(const Geometry& geometry)
+{
+    glBindVertexArray(array_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+    upload(GL_ARRAY_BUFFER, geometry.vertices, vertices, vertex_capacity);
+    if(geometry.indices.size() != 0)
+    {
+        upload(GL_ELEMENT_ARRAY_BUFFER, geometry.indices, indices, index_capacity);
+    }
+    no_vertices = geometry.vertices.size()/6;
+    no_indices = geometry.indices.size();
+    check_gl_error();
 }
 
 void Painter::GLObject::draw(GLenum mode)
 {
-    if(data.size() != 0)
+    if(no_vertices != 0)
     {
         glUseProgram(shader);
-        GLuint uniform = glGetUniformLocation(shader, "ambientMat");
-        if (uniform == NULL_LOCATION) {
-            std::cerr << "Shader did not contain the 'ambientMat' uniform."<<std::endl;
-        }
-        glUniform4fv(uniform, 1, &ambient_mat[0]);
+        glUniform4fv(ambient_uniform, 1, &ambient_mat[0]);
+        glUniform4fv(diffuse_uniform, 1, &diffuse_mat[0]);
+        glUniform4fv(specular_uniform, 1, &specular_mat[0]);
         
-        uniform = glGetUniformLocation(shader, "diffuseMat");
-        if (uniform == NULL_LOCATION) {
-            std::cerr << "Shader did not contain the 'diffuseMat' uniform."<<std::endl;
+        glBindVertexArray(array_id);
+        if(no_indices != 0)
+        {
+            glDrawElements(mode, static_cast<int>(no_indices), GL_UNSIGNED_INT, (const GLvoid *)0);
         }
-        glUniform4fv(uniform, 1, &diffuse_mat[0]);
-        
-        uniform = glGetUniformLocation(shader, "specMat");
-        if (uniform == NULL_LOCATION) {
-            std::cerr << "Shader did not contain the 'specMat' uniform."<<std::endl;
+        else {
+            glDrawArrays(mode, 0, static_cast<int>(no_vertices));
         }
-        glUniform4fv(uniform, 1, &specular_mat[0]);
-        
-        glUseProgram(shader);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
-        
-        glVertexAttribPointer(position_att, 3, GL_DOUBLE, GL_FALSE, 2.*sizeof(vec3), (const GLvoid *)0);
-        glVertexAttribPointer(vector_att, 3, GL_DOUBLE, GL_FALSE, 2.*sizeof(vec3), (const GLvoid *)sizeof(vec3));
-        
-        glDrawArrays(mode, 0, static_cast<int>(data.size())/2);
         check_gl_error();
     }
 }
@@ -181,39 +222,52 @@ GLuint Painter::init_shader(const char* vShaderFile, const char* fShaderFile, co
     return program;
 }
 
+GLuint Painter::get_uniform_location(GLuint shader, const char* name)
+{
+    GLuint uniform = glGetUniformLocation(shader, name);
+    if (uniform == NULL_LOCATION) {
+        std::cerr << "Shader did not contain the '" << name << "' uniform."<<std::endl;
+    }
+    return uniform;
+}
+
 Painter::Painter(const vec3& light_pos)
 {    
     // Initialize shader
-    wire_shader = init_shader("shaders/gouraud.vert", "shaders/wire.frag", "fragColour", "shaders/wire.geom");
+    wire_shader = init_shader("shaders/flat.vert", "shaders/wire.frag", "fragColour", "shaders/wire.geom");
     line_shader = init_shader("shaders/line.vert", "shaders/line.frag", "fragColour", "shaders/line.geom");
     gouraud_shader = init_shader("shaders/gouraud.vert",  "shaders/gouraud.frag", "fragColour");
+    flat_shader = init_shader("shaders/flat.vert",  "shaders/gouraud.frag", "fragColour", "shaders/flat.geom");
+    
+    gouraud_MV_uniform = get_uniform_location(gouraud_shader, "MVMatrix");
+    gouraud_MVP_uniform = get_uniform_location(gouraud_shader, "MVPMatrix");
+    gouraud_normal_uniform = get_uniform_location(gouraud_shader, "NormalMatrix");
+    flat_MV_uniform = get_uniform_location(flat_shader, "MVMatrix");
+    flat_MVP_uniform = get_uniform_location(flat_shader, "MVPMatrix");
+    line_MV_uniform = get_uniform_location(line_shader, "MVMatrix");
+    line_P_uniform = get_uniform_location(line_shader, "PMatrix");
+    line_normal_uniform = get_uniform_location(line_shader, "NormalMatrix");
+    wire_MV_uniform = get_uniform_location(wire_shader, "MVMatrix");
+    wire_MVP_uniform = get_uniform_location(wire_shader, "MVPMatrix");
+    wire_scale_uniform = get_uniform_location(wire_shader, "WScale");
     
     // Send light position uniform to the shader
     glUseProgram(gouraud_shader);
     CGLA::Vec3f lp(light_pos);
-    GLuint lightPosUniform = glGetUniformLocation(gouraud_shader, "lightPos");
-    if (lightPosUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'lightPos' uniform."<<std::endl;
-    }
-    glUniform3fv(lightPosUniform, 1, &lp[0]);
+    glUniform3fv(get_uniform_location(gouraud_shader, "lightPos"), 1, &lp[0]);
+    
+    glUseProgram(flat_shader);
+    glUniform3fv(get_uniform_location(flat_shader, "lightPos"), 1, &lp[0]);
     
     glUseProgram(wire_shader);
-    lightPosUniform = glGetUniformLocation(wire_shader, "lightPos");
-    if (lightPosUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'lightPos' uniform."<<std::endl;
-    }
-    glUniform3fv(lightPosUniform, 1, &lp[0]);
+    glUniform3fv(get_uniform_location(wire_shader, "lightPos"), 1, &lp[0]);
     
     CGLA::Vec4f wire_col(0.f,0.f,0.f, 1.f);
-    GLuint wireColUniform = glGetUniformLocation(wire_shader, "wireCol");
-    if (wireColUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'wireCol' uniform."<<std::endl;
-    }
-    glUniform4fv(wireColUniform, 1, &wire_col[0]);
+    glUniform4fv(get_uniform_location(wire_shader, "wireCol"), 1, &wire_col[0]);
     
     check_gl_error();
     
-    interface = std::unique_ptr<GLObject>(new GLObject(gouraud_shader, {0.15f,0.4f,0.5f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}));
+    interface = std::unique_ptr<GLObject>(new GLObject(flat_shader, {0.15f,0.4f,0.5f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}));
     wire_frame = std::unique_ptr<GLObject>(new GLObject(wire_shader, {0.15f,0.4f,0.5f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}, {0.2f, 0.3f, 0.4f, 1.f}));
     domain = std::unique_ptr<GLObject>(new GLObject(gouraud_shader, {0.1f, 0.1f, 0.3f, 1.f}, {0.2f, 0.2f, 0.3f, 1.f}, {0.f, 0.f, 0.f, 1.f}));
     low_quality = std::unique_ptr<GLObject>(new GLObject(gouraud_shader, {0.3f, 0.1f, 0.1f, 0.1f}, {0.6f, 0.4f, 0.4f, 0.2f}, {0.f, 0.f, 0.f, 0.f}));
@@ -233,9 +287,45 @@ Painter::Painter(const vec3& light_pos)
     check_gl_error();
 }
 
-void Painter::save_painting(std::string folder, int time_step)
+Painter::~Painter()
+{
+    if(framebuffer_id != 0)
+    {
+        glDeleteFramebuffers(1, &framebuffer_id);
+        glDeleteRenderbuffers(1, &colour_buffer_id);
+        glDeleteRenderbuffers(1, &depth_buffer_id);
+    }
+}
+
+void Painter::create_framebuffer(int width, int height)
+{
+    glGenFramebuffers(1, &framebuffer_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+    
+    glGenRenderbuffers(1, &colour_buffer_id);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour_buffer_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour_buffer_id);
+    
+    glGenRenderbuffers(1, &depth_buffer_id);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer_id);
+    
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "ERROR: Framebuffer is not complete." << std::endl;
+    }
+    
+    // The framebuffer stays bound, so all drawing and reading uses it from now on.
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    reshape(width, height);
+    check_gl_error();
+}
+
+std::string Painter::get_painting_name(const std::string& folder, int time_step)
 {
-    draw();
     std::ostringstream s;
     if (folder.length() == 0) {
         s << "scr";
@@ -249,14 +339,62 @@ void Painter::save_painting(std::string folder, int time_step)
         s << std::string(Util::concat4digits("_", time_step));
     }
     s << ".png";
-    int success = SOIL_save_screenshot(s.str().c_str(), SOIL_SAVE_TYPE_PNG, 0, 0, WIDTH, HEIGHT);
+    return s.str();
+}
+
+void Painter::save_painting(std::string folder, int time_step)
+{
+    draw();
+    std::string name = get_painting_name(folder, time_step);
+    int success = SOIL_save_screenshot(name.c_str(), SOIL_SAVE_TYPE_PNG, 0, 0, WIDTH, HEIGHT);
     if(!success)
     {
-        std::cout << "ERROR: Failed to take screen shot: " << s.str().c_str() << std::endl;
+        std::cout << "ERROR: Failed to take screen shot: " << name << std::endl;
         return;
     }
 }
 
+std::shared_ptr<std::vector<unsigned char>> Painter::get_pixel_buffer()
+{
+    for (auto& buffer : pixel_buffers)
+    {
+        if(buffer.use_count() == 1)
+        {
+            return buffer;
+        }
+    }
+    pixel_buffers.push_back(std::make_shared<std::vector<unsigned char>>());
+    return pixel_buffers.back();
+}
+
+void Painter::save_painting(Writer& writer, std::string folder, int time_step)
+{
+    draw();
+    int width = WIDTH, height = HEIGHT;
+    auto pixels = get_pixel_buffer();
+    pixels->resize(3*width*height);
+    
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels->data());
+    check_gl_error();
+    
+    std::string name = get_painting_name(folder, time_step);
+    writer.push([pixels, width, height, name]()
+    {
+        // OpenGL stores the rows bottom-up.
+        auto& data = *pixels;
+        for (int j = 0; j < height/2; j++)
+        {
+            std::swap_ranges(data.begin() + 3*width*j, data.begin() + 3*width*(j+1), data.begin() + 3*width*(height-1-j));
+        }
+        int success = SOIL_save_image(name.c_str(), SOIL_SAVE_TYPE_PNG, width, height, 3, data.data());
+        if(!success)
+        {
+            std::cout << "ERROR: Failed to take screen shot: " << name << std::endl;
+        }
+    });
+}
+
 void Painter::reshape(int width, int height)
 {
     WIDTH = width;
@@ -266,31 +404,17 @@ void Painter::reshape(int width, int height)
     CGLA::Mat4x4f modelViewProjectionMatrix = projectionMatrix * viewMatrix * modelMatrix;
     
     glUseProgram(gouraud_shader);
-    GLuint MVPMatrixUniform = glGetUniformLocation(gouraud_shader, "MVPMatrix");
-    if (MVPMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVPMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVPMatrixUniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
+    glUniformMatrix4fv(gouraud_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
+    
+    glUseProgram(flat_shader);
+    glUniformMatrix4fv(flat_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
     
     glUseProgram(line_shader);
-    GLuint PMatrixUniform = glGetUniformLocation(line_shader, "PMatrix");
-    if (PMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'PMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(PMatrixUniform, 1, GL_TRUE, &projectionMatrix[0][0]);
+    glUniformMatrix4fv(line_P_uniform, 1, GL_TRUE, &projectionMatrix[0][0]);
     
     glUseProgram(wire_shader);
-    MVPMatrixUniform = glGetUniformLocation(wire_shader, "MVPMatrix");
-    if (MVPMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVPMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVPMatrixUniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
-    
-    GLuint scaleUniform = glGetUniformLocation(wire_shader, "WScale");
-    if (scaleUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'WScale' uniform."<<std::endl;
-    }
-    glUniform2f(scaleUniform, width, height);
+    glUniformMatrix4fv(wire_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
+    glUniform2f(wire_scale_uniform, width, height);
     check_gl_error();
 }
 
@@ -302,55 +426,21 @@ void Painter::set_view_position(vec3 pos)
     CGLA::Mat4x4f modelViewProjectionMatrix = projectionMatrix * modelViewMatrix;
     
     glUseProgram(gouraud_shader);
-    GLuint MVMatrixUniform = glGetUniformLocation(gouraud_shader, "MVMatrix");
-    if (MVMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVMatrixUniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
+    glUniformMatrix4fv(gouraud_MV_uniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
+    glUniformMatrix4fv(gouraud_normal_uniform, 1, GL_FALSE, &normalMatrix[0][0]);
+    glUniformMatrix4fv(gouraud_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
     
-    GLuint NormalMatrixUniform = glGetUniformLocation(gouraud_shader, "NormalMatrix");
-    if (NormalMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'NormalMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(NormalMatrixUniform, 1, GL_FALSE, &normalMatrix[0][0]);
-    
-    GLuint MVPMatrixUniform = glGetUniformLocation(gouraud_shader, "MVPMatrix");
-    if (MVPMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVPMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVPMatrixUniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
+    glUseProgram(flat_shader);
+    glUniformMatrix4fv(flat_MV_uniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
+    glUniformMatrix4fv(flat_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
     
     glUseProgram(line_shader);
-    MVMatrixUniform = glGetUniformLocation(line_shader, "MVMatrix");
-    if (MVMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVMatrixUniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
-    
-    NormalMatrixUniform = glGetUniformLocation(line_shader, "NormalMatrix");
-    if (NormalMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'NormalMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(NormalMatrixUniform, 1, GL_FALSE, &normalMatrix[0][0]);
+    glUniformMatrix4fv(line_MV_uniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
+    glUniformMatrix4fv(line_normal_uniform, 1, GL_FALSE, &normalMatrix[0][0]);
     
     glUseProgram(wire_shader);
-    MVMatrixUniform = glGetUniformLocation(wire_shader, "MVMatrix");
-    if (MVMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVMatrixUniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
-    
-    MVPMatrixUniform = glGetUniformLocation(wire_shader, "MVPMatrix");
-    if (MVPMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'MVPMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(MVPMatrixUniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
-    
-    NormalMatrixUniform = glGetUniformLocation(wire_shader, "NormalMatrix");
-    if (NormalMatrixUniform == NULL_LOCATION) {
-        std::cerr << "Shader did not contain the 'NormalMatrix' uniform."<<std::endl;
-    }
-    glUniformMatrix4fv(NormalMatrixUniform, 1, GL_FALSE, &normalMatrix[0][0]);
+    glUniformMatrix4fv(wire_MV_uniform, 1, GL_TRUE, &modelViewMatrix[0][0]);
+    glUniformMatrix4fv(wire_MVP_uniform, 1, GL_TRUE, &modelViewProjectionMatrix[0][0]);
     
     check_gl_error();
 }
@@ -381,102 +471,116 @@ void Painter::switch_display_type()
 
 void Painter::update(DSC::DeformableSimplicialComplex<>& dsc)
 {
-    interface->clear_data();
-    wire_frame->clear_data();
-    edges->clear_data();
-    domain->clear_data();
-    low_quality->clear_data();
-    unmoved->clear_data();
+    Snapshot snapshot;
+    create_snapshot(dsc, snapshot);
+    upload(snapshot);
+}
+
+void Painter::create_snapshot(DSC::DeformableSimplicialComplex<>& dsc, Snapshot& snapshot)
+{
+    // Clearing keeps the capacity of a reused snapshot.
+    snapshot.interface.clear();
+    snapshot.wire_frame.clear();
+    snapshot.edges.clear();
+    snapshot.domain.clear();
+    snapshot.low_quality.clear();
+    snapshot.unmoved.clear();
     switch (display_type) {
         case INTERFACE:
-            update_interface(dsc);
+            update_interface(dsc, snapshot.interface);
             break;
         case WIRE_FRAME:
-            update_wire_frame(dsc);
+            update_wire_frame(dsc, snapshot.wire_frame);
             break;
         case BOUNDARY:
-            update_interface(dsc);
-            update_domain(dsc);
+            update_interface(dsc, snapshot.interface);
+            update_domain(dsc, snapshot.domain);
             break;
         case EDGES:
-            update_interface(dsc);
-            update_edges(dsc);
+            update_interface(dsc, snapshot.interface);
+            update_edges(dsc, snapshot.edges);
             break;
         case LOW_QUALITY:
-            update_interface(dsc);
-            update_low_quality(dsc);
+            update_interface(dsc, snapshot.interface);
+            update_low_quality(dsc, snapshot.low_quality);
             break;
         case UNMOVED:
-            update_interface(dsc);
-            update_unmoved(dsc);
+            update_interface(dsc, snapshot.interface);
+            update_unmoved(dsc, snapshot.unmoved);
             break;
             
         default:
             break;
     }
-    
 }
 
-void Painter::update_interface(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::upload(const Snapshot& snapshot)
 {
-    std::vector<vec3> data;
-    for (auto fit = dsc.faces_begin(); fit != dsc.faces_end(); fit++)
-    {
-        if (fit->is_interface())
-        {
-            auto verts = dsc.get_pos(dsc.get_sorted_nodes(fit.key()));
-            vec3 normal = Util::normal_direction(verts[0], verts[1], verts[2]);
-            
-            for(auto &p : verts)
-            {
-                data.push_back(p);
-                data.push_back(normal);
-            }
-        }
-    }
-    interface->add_data(data);
+    interface->add_data(snapshot.interface);
+    wire_frame->add_data(snapshot.wire_frame);
+    edges->add_data(snapshot.edges);
+    domain->add_data(snapshot.domain);
+    low_quality->add_data(snapshot.low_quality);
+    unmoved->add_data(snapshot.unmoved);
 }
 
-void Painter::update_wire_frame(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::update_interface(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
 {
-    std::vector<vec3> data;
+    // Each interface node is one vertex which is shared by the interface faces around it. Its normal is the sum of their normals. The shaders of the interface and the wire frame use the normals of the faces instead, so they are flat-shaded.
+    std::vector<int> vertex_index;
+    std::vector<is_mesh::NodeKey> nodes;
+    std::vector<vec3> normals;
     for (auto fit = dsc.faces_begin(); fit != dsc.faces_end(); fit++)
     {
         if (fit->is_interface())
         {
-            auto verts = dsc.get_pos(dsc.get_sorted_nodes(fit.key()));
+            auto nids = dsc.get_sorted_nodes(fit.key());
+            auto verts = dsc.get_pos(nids);
             vec3 normal = Util::normal_direction(verts[0], verts[1], verts[2]);
             
-            for(auto &p : verts)
+            for(auto n : nids)
             {
-                data.push_back(p);
-                data.push_back(normal);
+                if(n >= vertex_index.size())
+                {
+                    vertex_index.resize(n + 1, -1);
+                }
+                if(vertex_index[n] == -1)
+                {
+                    vertex_index[n] = static_cast<int>(nodes.size());
+                    nodes.push_back(n);
+                    normals.push_back(vec3(0.));
+                }
+                normals[vertex_index[n]] += normal;
+                geometry.indices.push_back(vertex_index[n]);
             }
         }
     }
-    wire_frame->add_data(data);
+    for (unsigned int i = 0; i < nodes.size(); i++)
+    {
+        geometry.add_vertex(dsc.get_pos(nodes[i]), normals[i]);
+    }
 }
 
-void Painter::update_edges(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::update_wire_frame(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
+{
+    update_interface(dsc, geometry);
+}
+
+void Painter::update_edges(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
 {
-    std::vector<vec3> data;
     for (auto eit = dsc.edges_begin(); eit != dsc.edges_end(); eit++)
     {
         auto nids = dsc.get_nodes(eit.key());
         if(!eit->is_interface())
         {
             vec3 vector = dsc.get_pos(nids[1]) - dsc.get_pos(nids[0]);
-            
-            data.push_back(dsc.get_pos(nids[0]));
-            data.push_back(vector);
+            geometry.add_vertex(dsc.get_pos(nids[0]), vector);
         }
     }
-    edges->add_data(data);
 }
 
-void Painter::update_domain(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::update_domain(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
 {
-    std::vector<vec3> data;
     for (auto fit = dsc.faces_begin(); fit != dsc.faces_end(); fit++)
     {
         if(fit->is_boundary())
@@ -485,17 +589,14 @@ void Painter::update_domain(DSC::DeformableSimplicialComplex<>& dsc)
             std::swap(verts[0], verts[2]);
             vec3 normal = Util::normal_direction(verts[0], verts[1], verts[2]);
             for (auto &p : verts) {
-                data.push_back(p);
-                data.push_back(normal);
+                geometry.add_vertex(p, normal);
             }
         }
     }
-    domain->add_data(data);
 }
 
-void Painter::update_low_quality(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::update_low_quality(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
 {
-    std::vector<vec3> data;
     for (auto tit = dsc.tetrahedra_begin(); tit != dsc.tetrahedra_end(); tit++)
     {
         if(dsc.quality(tit.key()) < dsc.get_min_tet_quality())
@@ -507,8 +608,7 @@ void Painter::update_low_quality(DSC::DeformableSimplicialComplex<>& dsc)
                 
                 for(auto &n : nodes)
                 {
-                    data.push_back(dsc.get_pos(n));
-                    data.push_back(normal);
+                    geometry.add_vertex(dsc.get_pos(n), normal);
                 }
             }
         }
@@ -522,33 +622,24 @@ void Painter::update_low_quality(DSC::DeformableSimplicialComplex<>& dsc)
             
             for(auto &n : nodes)
             {
-                data.push_back(dsc.get_pos(n));
-                data.push_back(normal);
+                geometry.add_vertex(dsc.get_pos(n), normal);
             }
         }
     }
-    low_quality->add_data(data);
 }
 
-void Painter::update_unmoved(DSC::DeformableSimplicialComplex<>& dsc)
+void Painter::update_unmoved(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry)
 {
-    std::vector<vec3> data;
-    data.push_back(vec3(0.));
-    data.push_back(vec3(20.,0.,0.));
-    data.push_back(vec3(0.));
-    data.push_back(vec3(0.,20.,0.));
-    data.push_back(vec3(0.));
-    data.push_back(vec3(0.,0.,20.));
+    geometry.add_vertex(vec3(0.), vec3(20.,0.,0.));
+    geometry.add_vertex(vec3(0.), vec3(0.,20.,0.));
+    geometry.add_vertex(vec3(0.), vec3(0.,0.,20.));
     
     for (auto nit = dsc.nodes_begin(); nit != dsc.nodes_end(); nit++)
     {
         vec3 vector = nit->get_destination() - nit->get_pos();
         if(vector.length() > EPSILON)
         {
-            data.push_back(nit->get_pos());
-            data.push_back(vector);
+            geometry.add_vertex(nit->get_pos(), vector);
         }
     }
-    unmoved->add_data(data);
 }
-
@@ -28,6 +28,7 @@
 #include <CGLA/Mat4x4f.h>
 
 #include "DSC.h"
+#include "writer.h"
 
 inline void _check_gl_error(const char *file, int line)
 {
@@ -61,14 +62,46 @@ class Painter {
     
     const static unsigned int NULL_LOCATION = -1;
     
+public:
+    
+    /**
+     Vertices with interleaved single precision positions and normals/vectors. If the indices are empty, the vertices are drawn in order, otherwise the indices are drawn.
+     */
+    struct Geometry {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        
+        void add_vertex(const vec3& p, const vec3& v)
+        {
+            vertices.insert(vertices.end(), {static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]),
+                static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2])});
+        }
+        
+        void clear()
+        {
+            vertices.clear();
+            indices.clear();
+        }
+    };
+    
+private:
+    
     class GLObject {
         
+        // The number of elements in a block which is either uploaded or not when a buffer is updated.
+        const static unsigned int BLOCK_SIZE = 1024;
+        
         GLuint shader;
         
-        std::vector<vec3> data;
+        // A copy of the data in the GPU buffers and the capacity of the buffers.
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        size_t vertex_capacity = 0, index_capacity = 0;
+        size_t no_vertices = 0, no_indices = 0;
         
-        GLuint array_id, buffer_id;
+        GLuint array_id, vertex_buffer_id, index_buffer_id;
         GLuint position_att, vector_att;
+        GLuint ambient_uniform, diffuse_uniform, specular_uniform;
         
         CGLA::Vec4f ambient_mat, diffuse_mat, specular_mat;
         
@@ -76,34 +109,70 @@ class Painter {
         
         GLObject(GLuint _shader, const CGLA::Vec4f& ambient_mat = CGLA::Vec4f(1.f), const CGLA::Vec4f& diffuse_mat = CGLA::Vec4f(0.f), const CGLA::Vec4f& specular_mat = CGLA::Vec4f(0.f));
         
-        void add_data(std::vector<vec3> _data);
+        /**
+         Updates the drawn geometry. Only the blocks of the buffers which have changed since the last update are uploaded.
+         */
+        void add_data(const Geometry& geometry);
         
         void clear_data()
         {
-            data.clear();
+            no_vertices = 0;
+            no_indices = 0;
         }
         
         void draw(GLenum mode = GL_TRIANGLES);
         
+    private:
+        
+        template<typename T>
+        static void upload(GLenum target, const std::vector<T>& data, std::vector<T>& uploaded, size_t& capacity);
     };
     
     int WIDTH, HEIGHT;
-    GLuint gouraud_shader, line_shader, wire_shader;
+    GLuint framebuffer_id = 0, colour_buffer_id, depth_buffer_id;
+    GLuint gouraud_shader, flat_shader, line_shader, wire_shader;
     
     std::unique_ptr<GLObject> interface, wire_frame, domain, low_quality, edges, unmoved;
     
+    // Pixel buffers which are reused when they are no longer used by a writer job.
+    std::vector<std::shared_ptr<std::vector<unsigned char>>> pixel_buffers;
+    
+    // Uniform locations
+    GLuint gouraud_MV_uniform, gouraud_MVP_uniform, gouraud_normal_uniform;
+    GLuint flat_MV_uniform, flat_MVP_uniform;
+    GLuint line_MV_uniform, line_P_uniform, line_normal_uniform;
+    GLuint wire_MV_uniform, wire_MVP_uniform, wire_scale_uniform;
+    
     // Uniform variables
     CGLA::Mat4x4f projectionMatrix, viewMatrix, modelMatrix = CGLA::rotation_Mat4x4f(CGLA::YAXIS, M_PI);
     CGLA::Vec3f center = CGLA::Vec3f(0.);
     
 public:
     
+    /**
+     The geometry of each of the drawn objects. A snapshot is created from the simplicial complex and can be uploaded to the GPU later, possibly after the simplicial complex has changed.
+     */
+    struct Snapshot {
+        int time_step = -1;
+        Geometry interface, wire_frame, domain, low_quality, edges, unmoved;
+    };
+    
     Painter(const vec3& light_pos);
     
+    ~Painter();
+    
+    /**
+     Creates a framebuffer with the given resolution which is drawn to instead of the window. Used for offscreen rendering, for example without a window.
+     */
+    void create_framebuffer(int width, int height);
+    
 private:
     // Create a GLSL program object from vertex and fragment shader files
     GLuint init_shader(const char* vShaderFile, const char* fShaderFile, const char* outputAttributeName, const char* gShaderFile = nullptr);
     
+    // Returns the location of the uniform with the given name and reports if the shader does not contain it
+    static GLuint get_uniform_location(GLuint shader, const char* name);
+    
 public:
     /**
      Reshape the window.
@@ -130,33 +199,58 @@ public:
      */
     void update(DSC::DeformableSimplicialComplex<>& dsc);
     
+    /**
+     Creates a snapshot of what to draw. Does not use OpenGL and can therefore be called from any thread.
+     */
+    void create_snapshot(DSC::DeformableSimplicialComplex<>& dsc, Snapshot& snapshot);
+    
+    /**
+     Updates what to draw from the snapshot.
+     */
+    void upload(const Snapshot& snapshot);
+    
     /**
      Saves the current painting to the selected folder.
      */
     void save_painting(std::string folder = std::string(""), int time_step = -1);
     
+    /**
+     Reads the current painting back and hands it to the writer which saves it to the selected folder. The image is encoded on the writer thread.
+     */
+    void save_painting(Writer& writer, std::string folder = std::string(""), int time_step = -1);
+    
 private:
+    /**
+     Returns the file name of the painting at the given time step.
+     */
+    std::string get_painting_name(const std::string& folder, int time_step);
+    
+    /**
+     Returns a pixel buffer which is not used by any writer job.
+     */
+    std::shared_ptr<std::vector<unsigned char>> get_pixel_buffer();
+    
     /**
      Updates the drawn interface.
      */
-    void update_interface(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_interface(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
     
-    void update_wire_frame(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_wire_frame(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
     
     /**
      Updates the drawn edges.
      */
-    void update_edges(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_edges(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
     
     /**
      Updates the drawn domain.
      */
-    void update_domain(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_domain(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
     
     /**
      Updates the drawn tetrahedra.
      */
-    void update_low_quality(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_low_quality(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
     
-    void update_unmoved(DSC::DeformableSimplicialComplex<>& dsc);
+    void update_unmoved(DSC::DeformableSimplicialComplex<>& dsc, Geometry& geometry);
 };
@@ -0,0 +1,281 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+
+#include "headless.h"
+
+#ifdef DSC_HEADLESS
+
+#include "rotate_function.h"
+#include "average_function.h"
+#include "normal_function.h"
+
+#include "mesh_io.h"
+#include "tetralizer.h"
+
+#include <EGL/eglext.h>
+#include <fstream>
+#include <sstream>
+
+using namespace DSC;
+
+Headless::Headless(int argc, char** argv)
+{
+    // Read input
+    char motion = '1';
+    real discretization = 2.5;
+    real velocity = 5.;
+    real accuracy = 0.25;
+    
+    for(int i = 0; i + 1 < argc; ++i)
+    {
+        std::string str(argv[i]);
+        if (str == "nu") {
+            velocity = std::atof(argv[i+1]);
+        }
+        else if (str == "delta") {
+            discretization = std::atof(argv[i+1]);
+        }
+        else if (str == "alpha") {
+            accuracy = std::atof(argv[i+1]);
+        }
+        else if (str == "model") {
+            model_file_name = argv[i+1];
+        }
+        else if (str == "motion") {
+            motion = *argv[i+1];
+        }
+        else if (str == "trace") {
+            Util::Trace::set_enabled(std::atoi(argv[i+1]) != 0);
+        }
+        else if (str == "export") {
+            export_meshes = std::atoi(argv[i+1]);
+        }
+        else if (str == "series") {
+            series_interval = std::atoi(argv[i+1]);
+        }
+        else if (str == "quantum") {
+            series_quantum = std::atof(argv[i+1]);
+        }
+        else if (str == "checkpoint") {
+            checkpoint_interval = std::atoi(argv[i+1]);
+        }
+        else if (str == "restart") {
+            restart_file_name = argv[i+1];
+        }
+        else if (str == "width") {
+            width = std::atoi(argv[i+1]);
+        }
+        else if (str == "height") {
+            height = std::atoi(argv[i+1]);
+        }
+    }
+    
+    create_context();
+    painter = std::unique_ptr<Painter>(new Painter(light_pos));
+    painter->create_framebuffer(width, height);
+    if (restart_file_name.empty())
+    {
+        load_model(model_file_name, discretization);
+    }
+    
+    switch (motion) {
+        case '2':
+            vel_fun = std::unique_ptr<VelocityFunc<>>(new AverageFunc(velocity, accuracy));
+            log_folder_name = "smooth";
+            break;
+        case '3':
+            vel_fun = std::unique_ptr<VelocityFunc<>>(new NormalFunc(velocity, accuracy));
+            log_folder_name = "expand";
+            break;
+        default:
+            vel_fun = std::unique_ptr<VelocityFunc<>>(new RotateFunc(velocity, accuracy));
+            log_folder_name = "rotate";
+            break;
+    }
+    if (!restart_file_name.empty())
+    {
+        restart(restart_file_name);
+    }
+}
+
+Headless::~Headless()
+{
+    writer.flush();
+    painter = nullptr;
+    if(display != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(context != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+    }
+}
+
+void Headless::create_context()
+{
+    // A surfaceless display does not need a window system. Otherwise the default display is used.
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(get_platform_display)
+    {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if(display == EGL_NO_DISPLAY)
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if(!eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cerr << "ERROR: Failed to initialize EGL." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    const EGLint attributes[] = {EGL_CONTEXT_MAJOR_VERSION_KHR, 3, EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR, EGL_NONE};
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cerr << "ERROR: Failed to create a surfaceless OpenGL context." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewInit();
+    if (GlewInitResult != GLEW_OK) {
+        // GLEW reports an error when there is no GLX display, but the OpenGL functions are loaded anyway.
+        printf("WARNING: %s\n", glewGetErrorString(GlewInitResult));
+    }
+    glGetError();
+    std::cout << "Rendering offscreen with " << glGetString(GL_RENDERER) << std::endl;
+}
+
+void Headless::load_model(const std::string& file_name, real discretization)
+{
+    std::cout << "\nLoading " << file_name << std::endl;
+    if(std::ifstream(obj_path + file_name + extension))
+    {
+        std::vector<vec3> points;
+        std::vector<int>  tets;
+        std::vector<int>  tet_labels;
+        is_mesh::import_tet_mesh(obj_path + file_name + extension, points, tets, tet_labels);
+        
+        dsc = std::unique_ptr<DeformableSimplicialComplex<>>(new DeformableSimplicialComplex<>(discretization, points, tets, tet_labels));
+        dsc->scale(vec3(20.));
+    }
+    else {
+        dsc = std::unique_ptr<DeformableSimplicialComplex<>>(Tetralizer::create_complex<DeformableSimplicialComplex<>>(obj_path + file_name + surface_extension, discretization, 20.));
+    }
+    dsc->set_design_domain(new Cube(vec3(0.), vec3(50.)));
+    dsc->set_cavity_tetralizer(Tetralizer::tetralize_cavity);
+    std::cout << "Loading done" << std::endl << std::endl;
+}
+
+void Headless::restart(const std::string& file_name)
+{
+    std::cout << "\nRestarting from " << file_name << std::endl;
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR: Could not open " << file_name << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // A failed load sets the failbit of the file, for example if the checkpoint was written in the other precision.
+    dsc = std::unique_ptr<DeformableSimplicialComplex<>>(new DeformableSimplicialComplex<>(file));
+    if (!file || !vel_fun->load_state(file))
+    {
+        std::cerr << "ERROR: " << file_name << " is not a checkpoint of this build." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    dsc->set_design_domain(new Cube(vec3(0.), vec3(50.)));
+    dsc->set_cavity_tetralizer(Tetralizer::tetralize_cavity);
+    std::cout << "Restarting done at time step " << vel_fun->get_time_step() << std::endl << std::endl;
+}
+
+void Headless::save_checkpoint()
+{
+    // The state is serialized on the simulation thread and written to the file by the writer.
+    std::ostringstream stream(std::ios::binary);
+    dsc->save_state(stream);
+    vel_fun->save_state(stream);
+    auto state = std::make_shared<std::string>(stream.str());
+    std::string file_name = Util::concat4digits(basic_log->get_path() + "/checkpoint_", vel_fun->get_time_step()) + ".state";
+    writer.push([file_name, state]()
+    {
+        std::ofstream file(file_name, std::ios::binary);
+        file.write(state->data(), state->size());
+    });
+}
+
+void Headless::record()
+{
+    painter->update(*dsc);
+    painter->set_view_position(camera_pos);
+    painter->save_painting(writer, basic_log->get_path(), vel_fun->get_time_step());
+}
+
+void Headless::run()
+{
+    basic_log = std::unique_ptr<Log>(new Log(log_path + log_folder_name));
+    basic_log->write_message(vel_fun->get_name().c_str());
+    basic_log->write_log(*vel_fun);
+    basic_log->write_log(*dsc);
+    if (series_interval > 0)
+    {
+        basic_log->start_series(series_interval, series_quantum);
+    }
+    record();
+    
+    while (!vel_fun->is_motion_finished(*dsc))
+    {
+        std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() + 1 <<  " START*************\n" << std::endl;
+        vel_fun->take_time_step(*dsc);
+        record();
+        
+        auto timestep = std::make_shared<Log::Timestep>(*vel_fun, *dsc, export_meshes, basic_log->get_series());
+        Log* log = basic_log.get();
+        writer.push([log, timestep]()
+        {
+            log->write_timestep(*timestep);
+        });
+        if (checkpoint_interval > 0 && vel_fun->get_time_step() % checkpoint_interval == 0)
+        {
+            save_checkpoint();
+        }
+        std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() <<  " STOP*************\n" << std::endl;
+    }
+    
+    writer.flush(); // The pending jobs write to the log.
+    basic_log->write_message("MOTION STOPPED");
+    basic_log->write_log(*dsc);
+    basic_log->write_log(*vel_fun);
+    basic_log->write_timings(*vel_fun);
+    
+    std::vector<vec3> points;
+    std::vector<int> faces;
+    std::vector<int> tets;
+    std::vector<int> tet_labels;
+    dsc->extract_tet_mesh(points, tets, tet_labels);
+    is_mesh::export_tet_mesh(basic_log->get_path() + std::string("/mesh.dsc"), points, tets, tet_labels);
+    points.clear();
+    dsc->extract_surface_mesh(points, faces);
+    is_mesh::export_surface_mesh(basic_log->get_path() + std::string("/mesh.obj"), points, faces);
+    basic_log = nullptr;
+}
+
+#endif
@@ -0,0 +1,113 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+
+#pragma once
+
+#ifdef DSC_HEADLESS
+
+#include "DSC.h"
+#include "velocity_function.h"
+#include "log.h"
+#include "draw.h"
+#include "writer.h"
+
+#include <EGL/egl.h>
+
+/**
+ Runs a recorded motion without a window. The scenes are drawn by the painter to an offscreen framebuffer of arbitrary resolution in a surfaceless EGL context, for example on a compute node without a display. The images and logs are written by a writer while the motion continues. Only available when compiled with DSC_HEADLESS and linked with EGL. Start the DEMO with the argument headless, for example
+ DEMO headless motion 1 model armadillo width 1920 height 1080
+ With the arguments trace 1, each time step is traced and written to trace_<time step>.json in the log folder, which can be opened in Perfetto (see Util::Trace).
+ With the arguments export 1, the tetrahedral mesh and the interface of each time step are written to the binary files mesh_<time step>.vtu and interface_<time step>.ply in the log folder. With export 2, the .vtu files are compressed.
+ With the arguments series 25, the mesh of each time step is written to the time series file series.dscs in the log folder with a keyframe every 25 time steps (see is_mesh::TimeSeriesWriter). With the additional arguments quantum 0.001, the positions are rounded to multiples of 0.001.
+ With the arguments checkpoint 10, the whole state of the simplicial complex and the velocity function is written to checkpoint_<time step>.state in the log folder every 10 time steps. The motion is continued from such a file with the arguments restart <file> together with the motion of the original run, for example
+ DEMO headless motion 1 restart LOG/rotate_test0000/checkpoint_0010.state
+ */
+class Headless
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    
+    std::unique_ptr<DSC::VelocityFunc<>> vel_fun;
+    std::unique_ptr<DSC::DeformableSimplicialComplex<>> dsc;
+    std::unique_ptr<Log> basic_log;
+    std::unique_ptr<Painter> painter;
+    Writer writer;
+    
+    std::string model_file_name = "armadillo";
+    std::string log_folder_name;
+    
+    vec3 camera_pos = {30., 30., 70.};
+    vec3 light_pos = {0., 0., 70.};
+    
+    int width = 700;
+    int height = 700;
+    int export_meshes = 0; // See Log::Timestep.
+    int series_interval = 0; // The keyframe interval of the time series, or 0 if no time series is written.
+    real series_quantum = 0.;
+    int checkpoint_interval = 0; // A checkpoint is written every checkpoint_interval time steps if positive.
+    std::string restart_file_name;
+    
+#ifdef _WIN32
+    const std::string obj_path = "data\\";
+    const std::string log_path = "LOG\\";
+#else
+    const std::string obj_path = "./data/";
+    const std::string log_path = "./LOG/";
+#endif
+    const std::string extension = ".dsc";
+    const std::string surface_extension = ".obj";
+    
+public:
+    
+    Headless(int argc, char** argv);
+    
+    ~Headless();
+    
+    /**
+     Runs the motion until it is finished and records every time step.
+     */
+    void run();
+    
+private:
+    
+    /**
+     Creates a surfaceless OpenGL 3.2 core profile context and makes it current.
+     */
+    void create_context();
+    
+    /**
+     Loads the .dsc file specified by the model_file_name variable. If no .dsc file exists, the complex is generated directly from the .obj file with the same name.
+     */
+    void load_model(const std::string& file_name, real discretization);
+    
+    /**
+     Replaces the simplicial complex and the state of the velocity function by a checkpoint written by save_checkpoint.
+     */
+    void restart(const std::string& file_name);
+    
+    /**
+     Writes the state of the simplicial complex and the velocity function to checkpoint_<time step>.state in the log folder.
+     */
+    void save_checkpoint();
+    
+    /**
+     Draws the current state of the simplicial complex and hands the painting to the writer.
+     */
+    void record();
+};
+
+#endif
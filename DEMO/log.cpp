@@ -15,6 +15,8 @@
 //  See licence.txt for a copy of the GNU General Public License.
 
 #include "log.h"
+#include "mesh_io.h"
+#include <cstdlib>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -23,8 +25,27 @@
 #include <sys/types.h>
 #endif
 
+// The zlib compressor of stb_image_write, which is compiled with SOIL (see SOIL/stb_image_write.c). The returned buffer must be freed with free.
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
 using namespace DSC;
 
+namespace {
+    
+    /**
+     Compresses a block of a .vtu file (see is_mesh::export_tet_mesh_vtu) with the zlib compressor of SOIL.
+     */
+    std::vector<unsigned char> compress_block(const unsigned char* data, size_t bytes)
+    {
+        int length;
+        unsigned char* compressed = stbi_zlib_compress(const_cast<unsigned char*>(data), static_cast<int>(bytes), &length, 8);
+        std::vector<unsigned char> block(compressed, compressed + length);
+        free(compressed);
+        return block;
+    }
+    
+}
+
 Log::Log(const std::string& path_)
 {
     std::string temp;
@@ -43,6 +64,11 @@ Log::Log(const std::string& path_)
     log.open(path + "/log.txt");
 }
 
+void Log::start_series(int keyframe_interval, double quantum)
+{
+    series = std::unique_ptr<is_mesh::TimeSeriesWriter>(new is_mesh::TimeSeriesWriter(path + "/series.dscs", keyframe_interval, quantum));
+}
+
 void Log::write_variable(const std::string& name, real value)
 {
     log << "\t" << name << "\t:\t" << value << std::endl;
@@ -75,6 +101,13 @@ void Log::write_variable(const std::string& name, const std::vector<real>& value
     }
 }
 
+void Log::write_memory(const std::string& name, const is_mesh::kernel_memory& memory)
+{
+    log << "\t" << name << " memory\t:\t" << memory.bytes_used/1e6 << "/" << memory.bytes_reserved/1e6 << " MB used/reserved, " << memory.heap_bytes/1e6 << " MB heap, "
+        << memory.size << "/" << memory.marked << "/" << memory.empty << " valid/marked/empty cells, "
+        << memory.fragmentation*100. << "% fragmentation" << std::endl;
+}
+
 void Log::write_variable(const std::string& name, const std::vector<int>& values)
 {
     if(values.size() > 0)
@@ -98,21 +131,66 @@ void Log::write_message(const std::string& message)
     std::cout << "*** " << message << " ***" << std::endl;
 }
 
+Log::Timestep::Timestep(const VelocityFunc<>& vel_fun, DeformableSimplicialComplex<>& dsc, int export_meshes_, is_mesh::TimeSeriesWriter* series) : export_meshes(export_meshes_)
+{
+    time_step = vel_fun.get_time_step();
+    compute_time = vel_fun.get_compute_time();
+    deform_time = vel_fun.get_deform_time();
+    memory = dsc.get_memory_usage(false).total_bytes();
+    
+    min_quality = dsc.min_quality();
+    std::vector<int> hist;
+    dsc.get_dihedral_angles(hist, min_angle, max_angle);
+    
+    if (Util::Trace::is_enabled())
+    {
+        trace = Util::Trace::collect();
+    }
+    
+    if (export_meshes)
+    {
+        dsc.extract_tet_mesh(points, tets, tet_labels);
+        dsc.extract_surface_mesh(surface_points, faces);
+    }
+    
+    if (series)
+    {
+        in_series = true;
+        series_frame = series->encode(dsc, time_step);
+    }
+}
+
 void Log::write_timestep(const VelocityFunc<>& vel_fun, DeformableSimplicialComplex<>& dsc)
 {
-    log << std::endl << "*** Time step #" << vel_fun.get_time_step() << " ***" << std::endl;
+    write_timestep(Timestep(vel_fun, dsc));
+}
+
+void Log::write_timestep(const Timestep& timestep)
+{
+    log << std::endl << "*** Time step #" << timestep.time_step << " ***" << std::endl;
     log << std::endl;
-    write_variable("Compute time", vel_fun.get_compute_time(), "s");
-    write_variable("Deform time", vel_fun.get_deform_time(), "s");
-    write_variable("Total time", vel_fun.get_compute_time() + vel_fun.get_deform_time(), "s");
+    write_variable("Compute time", timestep.compute_time, "s");
+    write_variable("Deform time", timestep.deform_time, "s");
+    write_variable("Total time", timestep.compute_time + timestep.deform_time, "s");
+    write_variable("Reserved memory", timestep.memory/1e6, "MB");
     
-    write_variable("Min quality", dsc.min_quality());
+    write_variable("Min quality", timestep.min_quality);
+    write_variable("Min dih. angle", timestep.min_angle, "degrees");
+    write_variable("Max dih. angle", timestep.max_angle, "degrees");
     
-    std::vector<int> hist;
-    real min_a, max_a;
-    dsc.get_dihedral_angles(hist, min_a, max_a);
-    write_variable("Min dih. angle", min_a, "degrees");
-    write_variable("Max dih. angle", max_a, "degrees");
+    if (!timestep.trace.empty())
+    {
+        Util::Trace::write(Util::concat4digits(path + "/trace_", timestep.time_step) + ".json", timestep.trace);
+    }
+    if (timestep.export_meshes)
+    {
+        is_mesh::export_tet_mesh_vtu(Util::concat4digits(path + "/mesh_", timestep.time_step) + ".vtu", timestep.points, timestep.tets, timestep.tet_labels, timestep.export_meshes == 2 ? compress_block : is_mesh::zlib_compressor());
+        is_mesh::export_surface_mesh_ply(Util::concat4digits(path + "/interface_", timestep.time_step) + ".ply", timestep.surface_points, timestep.faces);
+    }
+    if (timestep.in_series && series)
+    {
+        series->write(timestep.series_frame);
+    }
 }
 
 void Log::write_log(DeformableSimplicialComplex<>& dsc)
@@ -148,6 +226,13 @@ void Log::write_log(DeformableSimplicialComplex<>& dsc)
     write_variable("Min quality", min_a);
     write_variable("Qhist", hist);
     
+    is_mesh::MemoryUsage memory = dsc.get_memory_usage();
+    write_memory("nodes", memory.nodes);
+    write_memory("edges", memory.edges);
+    write_memory("faces", memory.faces);
+    write_memory("tetrahedra", memory.tetrahedra);
+    write_variable("Other memory", memory.other_bytes/1e6, "MB");
+    write_variable("Total memory", memory.total_bytes()/1e6, "MB");
 }
 
 void Log::write_log(const VelocityFunc<>& vel_fun)
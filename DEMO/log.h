@@ -19,8 +19,11 @@
 #include "util.h"
 #include "DSC.h"
 #include "velocity_function.h"
+#include "trace.h"
+#include "time_series.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 
 /**
@@ -30,6 +33,7 @@ class Log {
     
     std::string path;
     std::ofstream log;
+    std::unique_ptr<is_mesh::TimeSeriesWriter> series;
     
 public:
     /**
@@ -50,6 +54,19 @@ public:
         return path;
     }
     
+    /**
+     Starts writing the mesh of each time step to the time series file series.dscs next to the log (see is_mesh::TimeSeriesWriter). The file is closed when the log is destroyed.
+     */
+    void start_series(int keyframe_interval, double quantum);
+    
+    /**
+     Returns the time series writer, or nullptr if no time series is written.
+     */
+    is_mesh::TimeSeriesWriter* get_series()
+    {
+        return series.get();
+    }
+    
 private:
     /**
      Write a variable with name and value to the log.
@@ -73,8 +90,43 @@ private:
     
     void write_variable(const std::string& name, const std::vector<int>& values);
     
+    /**
+     Write the memory usage of a kernel with name to the log.
+     */
+    void write_memory(const std::string& name, const is_mesh::kernel_memory& memory);
+    
 public:
     
+    /**
+     A snapshot of the information which is written to the log after each time step. It can be written on another thread while the simulation continues. The quality measures are computed by the simplicial complex when the snapshot is taken, so only the results are stored.
+     */
+    struct Timestep {
+        int time_step;
+        real compute_time, deform_time;
+        size_t memory; // The bytes reserved by the simplicial complex. The heap bytes of the simplices are only counted by write_log.
+        
+        real min_quality, min_angle, max_angle; // The minimum quality and the range of dihedral angles in degrees of the tetrahedra.
+        
+        /// The trace events recorded since the previous snapshot if tracing is enabled (see Util::Trace).
+        std::vector<Util::Trace::Event> trace;
+        
+        /// 0 if the meshes are not exported, 1 if they are exported uncompressed and 2 if they are exported compressed.
+        int export_meshes;
+        
+        /// The tetrahedral mesh and the interface if they are exported.
+        std::vector<vec3> points, surface_points;
+        std::vector<int> tets, tet_labels, faces;
+        
+        /// The changes of the mesh since the previous time step if a time series is written.
+        bool in_series = false;
+        is_mesh::TimeSeriesWriter::Frame series_frame;
+        
+        /**
+         Takes the snapshot. If series is not nullptr, the mesh is encoded as the next frame of the time series, which is then written by write_timestep. The snapshots must therefore be written in the order they were taken.
+         */
+        Timestep(const DSC::VelocityFunc<>& vel_fun, DSC::DeformableSimplicialComplex<>& dsc, int export_meshes = 0, is_mesh::TimeSeriesWriter* series = nullptr);
+    };
+    
     /**
      Write a message to the terminal and the log.
      */
@@ -85,6 +137,11 @@ public:
      */
     void write_timestep(const DSC::VelocityFunc<>& vel_fun, DSC::DeformableSimplicialComplex<>& dsc);
     
+    /**
+     Write the time step number, timings and the quality measures computed from the snapshot to the log. The trace events of the snapshot, if any, are written to trace_<time step>.json next to the log. The exported meshes, if any, are written to mesh_<time step>.vtu and interface_<time step>.ply, and the frame of the time series, if any, is appended to series.dscs.
+     */
+    void write_timestep(const Timestep& timestep);
+    
     /**
      Writes simplicial complex information to the log.
      */
@@ -0,0 +1,88 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ A triple buffer passes data from a producer thread to a consumer thread without copying and without the threads waiting for each other. The producer writes to the back buffer and publishes it, the consumer reads the latest published buffer. Buffers which are published while the consumer is busy are skipped.
+ */
+template<typename T>
+class TripleBuffer {
+    
+    T buffers[3];
+    int back = 0, middle = 1, front = 2;
+    bool fresh = false;
+    
+    std::mutex mutex;
+    std::condition_variable consumed;
+    
+public:
+    
+    /**
+     Returns the buffer which the producer writes to.
+     */
+    T& get_back()
+    {
+        return buffers[back];
+    }
+    
+    /**
+     Returns the buffer which the consumer reads from.
+     */
+    const T& get_front()
+    {
+        return buffers[front];
+    }
+    
+    /**
+     Publishes the back buffer. Called by the producer when it has finished writing to the back buffer.
+     */
+    void publish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(back, middle);
+        fresh = true;
+    }
+    
+    /**
+     Makes the latest published buffer the front buffer. Returns false if nothing has been published since the last call.
+     */
+    bool consume()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!fresh)
+        {
+            return false;
+        }
+        std::swap(front, middle);
+        fresh = false;
+        consumed.notify_all();
+        return true;
+    }
+    
+    /**
+     Waits until the consumer has consumed the latest published buffer. Used by the producer if no buffer may be skipped.
+     */
+    void wait_until_consumed()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        consumed.wait(lock, [this]{ return !fresh; });
+    }
+};
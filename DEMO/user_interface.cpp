@@ -20,6 +20,9 @@
 #include "normal_function.h"
 
 #include "mesh_io.h"
+#include "tetralizer.h"
+
+#include <fstream>
 
 using namespace DSC;
 
@@ -45,7 +48,7 @@ void animate_(){
 
 UI* UI::instance = NULL;
 
-UI::UI(int &argc, char** argv)
+UI::UI(int &argc, char** argv) : MOTION_FINISHED(false)
 {
     instance = this;
 
@@ -97,9 +100,22 @@ UI::UI(int &argc, char** argv)
             else if (str == "motion") {
                 motion = argv[i+1];
             }
+            else if (str == "trace") {
+                Util::Trace::set_enabled(std::atoi(argv[i+1]) != 0);
+            }
+            else if (str == "export") {
+                EXPORT_MESHES = std::atoi(argv[i+1]);
+            }
+            else if (str == "series") {
+                SERIES_INTERVAL = std::atoi(argv[i+1]);
+            }
+            else if (str == "quantum") {
+                SERIES_QUANTUM = std::atof(argv[i+1]);
+            }
         }
     }
     painter = std::unique_ptr<Painter>(new Painter(light_pos));
+    writer = std::unique_ptr<Writer>(new Writer());
     load_model(model_file_name, discretization);
     
     if(motion.empty())
@@ -113,28 +129,48 @@ UI::UI(int &argc, char** argv)
     
 	glutReshapeWindow(WIN_SIZE_X, WIN_SIZE_Y);
     check_gl_error();
+    
+    simulation_thread = std::thread(&UI::simulate, this);
+}
+
+UI::~UI()
+{
+    {
+        std::lock_guard<std::mutex> lock(simulation_mutex);
+        QUIT = true;
+    }
+    simulation_resumed.notify_one();
+    simulation_thread.join();
 }
 
 void UI::load_model(const std::string& file_name, real discretization)
 {
     std::cout << "\nLoading " << file_name << std::endl;
     dsc = nullptr;
-    std::vector<vec3> points;
-    std::vector<int>  tets;
-    std::vector<int>  tet_labels;
-    is_mesh::import_tet_mesh(obj_path + file_name + extension, points, tets, tet_labels);
-    
-    dsc = std::unique_ptr<DeformableSimplicialComplex<>>(new DeformableSimplicialComplex<>(discretization, points, tets, tet_labels));
+    if(std::ifstream(obj_path + file_name + extension))
+    {
+        std::vector<vec3> points;
+        std::vector<int>  tets;
+        std::vector<int>  tet_labels;
+        is_mesh::import_tet_mesh(obj_path + file_name + extension, points, tets, tet_labels);
+        
+        dsc = std::unique_ptr<DeformableSimplicialComplex<>>(new DeformableSimplicialComplex<>(discretization, points, tets, tet_labels));
+        dsc->scale(vec3(20.));
+    }
+    else {
+        // No .dsc file exists, so the complex is generated in memory from the surface mesh in the .obj file.
+        dsc = std::unique_ptr<DeformableSimplicialComplex<>>(Tetralizer::create_complex<DeformableSimplicialComplex<>>(obj_path + file_name + surface_extension, discretization, 20.));
+    }
     dsc->set_design_domain(new Cube(vec3(0.), vec3(50.)));
-    dsc->scale(vec3(20.));
+    dsc->set_cavity_tetralizer(Tetralizer::tetralize_cavity);
     painter->update(*dsc);
     std::cout << "Loading done" << std::endl << std::endl;
 }
 
-void UI::update_title()
+void UI::update_title(int time_step)
 {
     std::ostringstream oss;
-    oss << "3D DSC\t" << vel_fun->get_name() << ", Time step " << vel_fun->get_time_step();
+    oss << "3D DSC\t" << vel_fun->get_name() << ", Time step " << time_step;
     oss << " (Nu = " << vel_fun->get_velocity() << ", Delta = " << dsc->get_avg_edge_length() << ", Alpha = " << vel_fun->get_accuracy() << ")";
     std::string str(oss.str());
     glutSetWindowTitle(str.c_str());
@@ -150,7 +186,6 @@ void UI::display()
     painter->set_view_position(ep);
     painter->draw();
     glutSwapBuffers();
-    update_title();
     check_gl_error();
 }
 
@@ -161,35 +196,89 @@ void UI::reshape(int width, int height)
     painter->reshape(width, height);
 }
 
-void UI::animate()
+void UI::simulate()
+{
+    while (true)
+    {
+        bool record;
+        {
+            std::unique_lock<std::mutex> lock(simulation_mutex);
+            simulation_resumed.wait(lock, [this]{ return QUIT || (CONTINUOUS && !MOTION_FINISHED); });
+            if(QUIT)
+            {
+                return;
+            }
+            record = RECORD; // Read under the lock since keyboard changes it.
+            
+            std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() + 1 <<  " START*************\n" << std::endl;
+            vel_fun->take_time_step(*dsc);
+            
+            Painter::Snapshot& snapshot = snapshots.get_back();
+            painter->create_snapshot(*dsc, snapshot);
+            snapshot.time_step = vel_fun->get_time_step();
+            snapshots.publish();
+            
+            if(record && basic_log)
+            {
+                auto timestep = std::make_shared<Log::Timestep>(*vel_fun, *dsc, EXPORT_MESHES, basic_log->get_series());
+                Log* log = basic_log.get();
+                writer->push([log, timestep]()
+                {
+                    log->write_timestep(*timestep);
+                });
+            }
+            if (vel_fun->is_motion_finished(*dsc))
+            {
+                MOTION_FINISHED = true;
+            }
+            std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() <<  " STOP*************\n" << std::endl;
+        }
+        if(record)
+        {
+            // Every time step is painted when recording.
+            snapshots.wait_until_consumed();
+        }
+    }
+}
+
+void UI::display_snapshot()
 {
-    if(CONTINUOUS)
+    if(snapshots.consume())
     {
-        std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() + 1 <<  " START*************\n" << std::endl;
-        vel_fun->take_time_step(*dsc);
-        painter->update(*dsc);
+        const Painter::Snapshot& snapshot = snapshots.get_front();
+        painter->upload(snapshot);
         if(RECORD && basic_log)
         {
             painter->set_view_position(camera_pos);
-            painter->save_painting(basic_log->get_path(), vel_fun->get_time_step());
-            basic_log->write_timestep(*vel_fun, *dsc);
+            painter->save_painting(*writer, basic_log->get_path(), snapshot.time_step);
         }
-        if (vel_fun->is_motion_finished(*dsc))
-        {
-            stop();
-            if (QUIT_ON_COMPLETION) {
-                exit(0);
-            }
+        update_title(snapshot.time_step);
+    }
+}
+
+void UI::animate()
+{
+    display_snapshot();
+    if (MOTION_FINISHED)
+    {
+        std::lock_guard<std::mutex> lock(simulation_mutex);
+        display_snapshot();
+        stop();
+        if (QUIT_ON_COMPLETION) {
+            writer->flush();
+            exit(0);
         }
-        std::cout << "\n***************TIME STEP " << vel_fun->get_time_step() <<  " STOP*************\n" << std::endl;
     }
     glutPostRedisplay();
 }
 
 void UI::keyboard(unsigned char key, int x, int y) {
+    std::lock_guard<std::mutex> lock(simulation_mutex);
+    display_snapshot(); // Otherwise a snapshot of the simulation before the change could be drawn after the change.
     switch(key) {
         case '\033':
             stop();
+            writer->flush();
             exit(0);
             break;
         case '0':
@@ -227,7 +316,7 @@ void UI::keyboard(unsigned char key, int x, int y) {
                 if(RECORD && basic_log)
                 {
                     painter->set_view_position(camera_pos);
-                    painter->save_painting(basic_log->get_path(), vel_fun->get_time_step());
+                    painter->save_painting(*writer, basic_log->get_path(), vel_fun->get_time_step());
                 }
             }
             else {
@@ -283,45 +372,46 @@ void UI::keyboard(unsigned char key, int x, int y) {
         {
             real velocity = std::min(vel_fun->get_velocity() + 1., 100.);
             vel_fun->set_velocity(velocity);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
         case '-':
         {
             real velocity = std::max(vel_fun->get_velocity() - 1., 0.);
             vel_fun->set_velocity(velocity);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
         case '.':
         {
             real discretization = std::min(dsc->get_avg_edge_length() + 0.5, 100.);
             dsc->set_avg_edge_length(discretization);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
         case ',':
         {
             real discretization = std::max(dsc->get_avg_edge_length() - 0.5, 1.);
             dsc->set_avg_edge_length(discretization);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
         case '<':
         {
             real accuracy = std::min(vel_fun->get_accuracy() + 1., 100.);
             vel_fun->set_accuracy(accuracy);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
         case '>':
         {
             real accuracy = std::max(vel_fun->get_accuracy() - 1., 1.);
             vel_fun->set_accuracy(accuracy);
-            update_title();
+            update_title(vel_fun->get_time_step());
         }
             break;
     }
+    simulation_resumed.notify_one();
 }
 
 void UI::visible(int v)
@@ -336,26 +426,34 @@ void UI::stop()
 {
     if(RECORD && basic_log)
     {
+        writer->flush(); // The pending jobs write to the log.
         basic_log->write_message("MOTION STOPPED");
         basic_log->write_log(*dsc);
         basic_log->write_log(*vel_fun);
         basic_log->write_timings(*vel_fun);
         
-        std::vector<vec3> points;
-        std::vector<int> faces;
-        std::vector<int> tets;
-        std::vector<int> tet_labels;
-        dsc->extract_tet_mesh(points, tets, tet_labels);
-        is_mesh::export_tet_mesh(basic_log->get_path() + std::string("/mesh.dsc"), points, tets, tet_labels);
-        points.clear();
-        dsc->extract_surface_mesh(points, faces);
-        is_mesh::export_surface_mesh(basic_log->get_path() + std::string("/mesh.obj"), points, faces);
+        auto points = std::make_shared<std::vector<vec3>>();
+        auto tets = std::make_shared<std::vector<int>>();
+        auto tet_labels = std::make_shared<std::vector<int>>();
+        dsc->extract_tet_mesh(*points, *tets, *tet_labels);
+        
+        auto surface_points = std::make_shared<std::vector<vec3>>();
+        auto faces = std::make_shared<std::vector<int>>();
+        dsc->extract_surface_mesh(*surface_points, *faces);
+        
+        std::string path = basic_log->get_path();
+        writer->push([path, points, tets, tet_labels, surface_points, faces]()
+        {
+            is_mesh::export_tet_mesh(path + std::string("/mesh.dsc"), *points, *tets, *tet_labels);
+            is_mesh::export_surface_mesh(path + std::string("/mesh.obj"), *surface_points, *faces);
+        });
         basic_log = nullptr;
     }
     
     CONTINUOUS = false;
+    MOTION_FINISHED = false;
     painter->update(*dsc);
-    update_title();
+    update_title(vel_fun->get_time_step());
     glutPostRedisplay();
 }
 
@@ -365,13 +463,17 @@ void UI::start(const std::string& log_folder_name)
     {
         basic_log = std::unique_ptr<Log>(new Log(log_path + log_folder_name));
         painter->set_view_position(camera_pos);
-        painter->save_painting(log_path, vel_fun->get_time_step());
+        painter->save_painting(*writer, log_path, vel_fun->get_time_step());
         basic_log->write_message(vel_fun->get_name().c_str());
         basic_log->write_log(*vel_fun);
         basic_log->write_log(*dsc);
+        if (SERIES_INTERVAL > 0)
+        {
+            basic_log->start_series(SERIES_INTERVAL, SERIES_QUANTUM);
+        }
     }
     
     painter->update(*dsc);
-    update_title();
+    update_title(vel_fun->get_time_step());
     glutPostRedisplay();
 }
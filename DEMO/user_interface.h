@@ -20,6 +20,11 @@
 #include "velocity_function.h"
 #include "log.h"
 #include "draw.h"
+#include "writer.h"
+#include "triple_buffer.h"
+
+#include <thread>
+#include <atomic>
 
 /**
  A default application which utilizes OpenGL, GLEW and GLUT for visualization. Three sample velocity functions (rotation, smoothing and expansion) can be applies to a model specified by the model_file_name variable or as input variable. See https://github.com/asny/DSC/wiki/DEMO-instructions for details on how to use this DEMO application. See https://github.com/asny/DSC/wiki/Instructions for instructions on how to build your own application which uses the implementation of the DSC method.
@@ -30,6 +35,13 @@ class UI
     std::unique_ptr<DSC::DeformableSimplicialComplex<>> dsc;
     std::unique_ptr<Log> basic_log;
     std::unique_ptr<Painter> painter;
+    std::unique_ptr<Writer> writer;
+    
+    // The simulation runs on its own thread which publishes snapshots of what to draw. The simulation mutex is held while the simulation thread takes a time step and by the GLUT thread while it changes the simulation.
+    std::thread simulation_thread;
+    std::mutex simulation_mutex;
+    std::condition_variable simulation_resumed;
+    TripleBuffer<Painter::Snapshot> snapshots;
     
     std::string model_file_name = "armadillo";
     
@@ -45,7 +57,12 @@ class UI
     
     bool CONTINUOUS = false;
     bool RECORD = false;
+    int EXPORT_MESHES = 0; // See Log::Timestep.
+    int SERIES_INTERVAL = 0; // The keyframe interval of the time series, or 0 if no time series is written (see Log::start_series).
+    real SERIES_QUANTUM = 0.;
     bool QUIT_ON_COMPLETION = false;
+    bool QUIT = false;
+    std::atomic<bool> MOTION_FINISHED;
     
     static UI* instance;
     
@@ -57,11 +74,14 @@ class UI
     const std::string log_path = "./LOG/";
 #endif
     const std::string extension = ".dsc";
+    const std::string surface_extension = ".obj";
     
 public:
     
     UI(int &argc, char** argv);
     
+    ~UI();
+    
     static UI* get_instance()
     {
         return instance;
@@ -97,14 +117,24 @@ private:
     }
     
     /**
-     Loads the .dsc file specified by the model_file_name variable.
+     Loads the .dsc file specified by the model_file_name variable. If no .dsc file exists, the complex is generated directly from the .obj file with the same name.
      */
     void load_model(const std::string& file_name, real discretization);
     
     /**
      Updates the window title.
      */
-    void update_title();
+    void update_title(int time_step);
+    
+    /**
+     Takes time steps on the simulation thread while the motion is running.
+     */
+    void simulate();
+    
+    /**
+     Uploads the latest snapshot published by the simulation thread, if any, and saves the painting if recording.
+     */
+    void display_snapshot();
     
     /**
      Starts the motion.
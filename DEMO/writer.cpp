@@ -0,0 +1,75 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#include "writer.h"
+#include "trace.h"
+
+Writer::Writer()
+{
+    thread = std::thread(&Writer::run, this);
+}
+
+Writer::~Writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    job_added.notify_one();
+    thread.join();
+}
+
+void Writer::push(const std::function<void()>& job)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this]{ return jobs.size() < MAX_PENDING_JOBS; });
+    jobs.push_back(job);
+    lock.unlock();
+    job_added.notify_one();
+}
+
+void Writer::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this]{ return jobs.empty() && !busy; });
+}
+
+void Writer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        job_added.wait(lock, [this]{ return quit || !jobs.empty(); });
+        if (jobs.empty())
+        {
+            return;
+        }
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+        
+        {
+            Util::Trace::Scope trace("writer job");
+            job();
+        }
+        job = nullptr; // Releases the snapshot held by the job before the job is reported as done.
+        
+        lock.lock();
+        busy = false;
+        job_done.notify_all();
+    }
+}
@@ -0,0 +1,62 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ A writer executes output jobs, for example encoding of images and writing of logs, in order on a separate thread. This means that the simulation and the output overlap. The jobs should only use snapshots of the data they write. At most MAX_PENDING_JOBS job is waiting while another job is executed, i.e. the snapshots are double buffered.
+ */
+class Writer {
+    
+    const static unsigned int MAX_PENDING_JOBS = 1;
+    
+    std::deque<std::function<void()>> jobs;
+    bool busy = false;
+    bool quit = false;
+    
+    std::mutex mutex;
+    std::condition_variable job_added, job_done;
+    std::thread thread;
+
+public:
+    
+    Writer();
+    
+    /**
+     Finishes all pending jobs before the writer thread is stopped.
+     */
+    ~Writer();
+    
+    /**
+     Adds a job to the queue. Blocks if MAX_PENDING_JOBS jobs are already waiting.
+     */
+    void push(const std::function<void()>& job);
+    
+    /**
+     Waits until all pending jobs are done.
+     */
+    void flush();
+
+private:
+    
+    void run();
+};
@@ -26,17 +26,13 @@ const std::string file_path = "./data/";
 #endif
 const string extension = ".dsc";
 
-void generate_from_obj(const string& input_file_name, const string& output_file_name)
+void generate_from_obj(const string& input_file_name, const string& output_file_name, real grading)
 {
     vector<vec3> points;
     vector<int> tets;
     vector<int> tet_labels;
     
-    std::vector<vec3> points_interface;
-    std::vector<int> faces_interface;
-    is_mesh::import_surface_mesh(file_path + input_file_name, points_interface, faces_interface);
-    
-    Tetralizer::tetralize(vec3(3.), 0.5, points_interface, faces_interface, points, tets, tet_labels);
+    Tetralizer::tetralize(vec3(3.), 0.5, file_path + input_file_name, points, tets, tet_labels, grading);
     
     is_mesh::export_tet_mesh(file_path + output_file_name + extension, points, tets, tet_labels);
 }
@@ -47,7 +43,8 @@ int main(int argc, const char * argv[])
     {
         string output_file_name = string(argv[1]);
         string input_file_name = string(argv[2]);
-        generate_from_obj(input_file_name, output_file_name);
+        real grading = argc > 3 ? std::atof(argv[3]) : 0.;
+        generate_from_obj(input_file_name, output_file_name, grading);
         
         std::cout << "Generated " << output_file_name + extension << std::endl;
     }
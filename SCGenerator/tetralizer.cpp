@@ -17,114 +17,194 @@
 #include "tetralizer.h"
 #include "tetgen.h"
 
-static char* tetgen_flags = "pq1.5Y";
+#include <thread>
+
+static char tetgen_flags[] = "pq1.5Y";
+static char cavity_tetgen_flags[] = "pq1.5YQ";
 
 int get_index(int i, int j, int k, int Ni, int Nj, int Nk)
 {
     return i + j*Ni + k*Ni*Nj;
 }
 
-void Tetralizer::tetralize_cube1(int i, int j, int k, int Ni, int Nj, int Nk, std::vector<int>& tets)
+// The parameters of the sizing function. TetGen only accepts a plain function pointer as sizing function, hence the static variables. They are
+// thread local since TetGen calls the sizing function on the thread which tetralizes, so graded tetralizations on different threads do not interfere.
+static thread_local real sizing_edge_length = 0.;
+static thread_local real sizing_grading = 0.;
+static thread_local vec3 sizing_min, sizing_max;
+
+/**
+ * Returns the target edge length at the point p which grows linearly with the distance from p to the bounding box of the interface.
+ */
+real get_edge_length(const vec3& p)
+{
+    vec3 d(0.);
+    for (int i = 0; i < 3; i++)
+    {
+        d[i] = Util::max(Util::max(sizing_min[i] - p[i], p[i] - sizing_max[i]), 0.);
+    }
+    return sizing_edge_length + sizing_grading*length(d);
+}
+
+/**
+ * Returns whether the average edge length of the tetrahedron with corners pa, pb, pc and pd is longer than the target edge length at its center.
+ */
+bool is_too_large(REAL* pa, REAL* pb, REAL* pc, REAL* pd, REAL* /*elen*/, REAL /*vol*/)
+{
+    vec3 corners[4] = {vec3(pa[0], pa[1], pa[2]), vec3(pb[0], pb[1], pb[2]), vec3(pc[0], pc[1], pc[2]), vec3(pd[0], pd[1], pd[2])};
+    real avg_length = 0.;
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = i+1; j < 4; j++)
+        {
+            avg_length += length(corners[i] - corners[j])/6.;
+        }
+    }
+    return avg_length > get_edge_length(0.25*(corners[0] + corners[1] + corners[2] + corners[3]));
+}
+
+void set_sizing(const std::vector<real>& points_interface, real avg_edge_length, real grading)
+{
+    sizing_edge_length = avg_edge_length;
+    sizing_grading = grading;
+    sizing_min = vec3(INFINITY);
+    sizing_max = vec3(-INFINITY);
+    for (unsigned int i = 0; i < points_interface.size(); i++)
+    {
+        sizing_min[i%3] = Util::min(sizing_min[i%3], points_interface[i]);
+        sizing_max[i%3] = Util::max(sizing_max[i%3], points_interface[i]);
+    }
+}
+
+void Tetralizer::parallel_for_slabs(int N, const std::function<void(int, int)>& function)
+{
+    int no_threads = Util::max(1, Util::min(N, static_cast<int>(std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < no_threads; t++)
+    {
+        threads.push_back(std::thread(function, (t*N)/no_threads, ((t+1)*N)/no_threads));
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void Tetralizer::tetralize_cube1(int i, int j, int k, int Ni, int Nj, int Nk, int* tets)
 {
     // First tetrahedron:
-    tets.push_back(get_index(i, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k+1, Ni, Nj, Nk);
     
     // Second tetrahedron:
-    tets.push_back(get_index(i, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k, Ni, Nj, Nk);
     
     // Third tetrahedron:
-    tets.push_back(get_index(i, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k+1, Ni, Nj, Nk);
     
     // Fourth tetrahedron:
-    tets.push_back(get_index(i+1, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k, Ni, Nj, Nk));
+    *tets++ = get_index(i+1, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k, Ni, Nj, Nk);
     
     // Fifth tetrahedron:
-    tets.push_back(get_index(i, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k+1, Ni, Nj, Nk);
 }
 
-void Tetralizer::tetralize_cube2(int i, int j, int k, int Ni, int Nj, int Nk, std::vector<int>& tets)
+void Tetralizer::tetralize_cube2(int i, int j, int k, int Ni, int Nj, int Nk, int* tets)
 {
     // First tetrahedron:
-    tets.push_back(get_index(i, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k, Ni, Nj, Nk);
     
     // Second tetrahedron:
-    tets.push_back(get_index(i, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k, Ni, Nj, Nk));
+    *tets++ = get_index(i, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k, Ni, Nj, Nk);
     
     // Third tetrahedron:
-    tets.push_back(get_index(i, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i, j, k+1, Ni, Nj, Nk);
     
     // Fourth tetrahedron:
-    tets.push_back(get_index(i+1, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i+1, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k+1, Ni, Nj, Nk);
     
     // Fifth tetrahedron:
-    tets.push_back(get_index(i, j, k+1, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i, j+1, k, Ni, Nj, Nk));
-    tets.push_back(get_index(i+1, j+1, k+1, Ni, Nj, Nk));
+    *tets++ = get_index(i, j, k+1, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j, k, Ni, Nj, Nk);
+    *tets++ = get_index(i, j+1, k, Ni, Nj, Nk);
+    *tets++ = get_index(i+1, j+1, k+1, Ni, Nj, Nk);
 }
 
 void Tetralizer::create_tets(int Ni, int Nj, int Nk, std::vector<int>& tets)
 {
-    for (int k = 0; k < Nk-1; k++) {
-        for (int j = 0; j < Nj-1; j++) {
-            for (int i = 0; i < Ni-1; i++)
-            {
-                if((i + j + k)%2 == 0)
+    tets.resize(20*(Ni-1)*(Nj-1)*(Nk-1));
+    parallel_for_slabs(Nk-1, [&](int k_begin, int k_end)
+    {
+        for (int k = k_begin; k < k_end; k++) {
+            for (int j = 0; j < Nj-1; j++) {
+                for (int i = 0; i < Ni-1; i++)
                 {
-                    tetralize_cube1(i, j, k, Ni, Nj, Nk, tets);
-                }
-                else {
-                    tetralize_cube2(i, j, k, Ni, Nj, Nk, tets);
+                    int* cube_tets = &tets[20*(i + j*(Ni-1) + k*(Ni-1)*(Nj-1))];
+                    if((i + j + k)%2 == 0)
+                    {
+                        tetralize_cube1(i, j, k, Ni, Nj, Nk, cube_tets);
+                    }
+                    else {
+                        tetralize_cube2(i, j, k, Ni, Nj, Nk, cube_tets);
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 void Tetralizer::create_points(const vec3& size, real avg_edge_length, int Ni, int Nj, int Nk, std::vector<vec3>& points)
 {
-    for (int k = 0; k < Nk; k++) {
-        for (int j = 0; j < Nj; j++) {
-            for (int i = 0; i < Ni; i++)
-            {
-                points.push_back(vec3(Util::min(i*avg_edge_length, size[0]) - size[0]/2.,
-                Util::min(j*avg_edge_length, size[1]) - size[1]/2.,
-                Util::min(k*avg_edge_length, size[2]) - size[2]/2.));
+    points.resize(Ni*Nj*Nk);
+    parallel_for_slabs(Nk, [&](int k_begin, int k_end)
+    {
+        for (int k = k_begin; k < k_end; k++) {
+            for (int j = 0; j < Nj; j++) {
+                for (int i = 0; i < Ni; i++)
+                {
+                    points[get_index(i, j, k, Ni, Nj, Nk)] = vec3(Util::min(i*avg_edge_length, size[0]) - size[0]/2.,
+                                                                 Util::min(j*avg_edge_length, size[1]) - size[1]/2.,
+                                                                 Util::min(k*avg_edge_length, size[2]) - size[2]/2.);
+                }
             }
         }
-    }
+    });
 }
 
 void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d, std::vector<int>& faces_boundary, const vec3& size)
 {
-    int n = size[0]/d;
+    int n = static_cast<int>(std::round(size[0]/d)); // d divides the size, but the quotient may be rounded down in single precision.
+    // The coordinate of the i'th grid point along an axis. The last point is placed exactly on the opposite side, such that the sides of the boundary mesh are planar also in single precision.
+    auto coordinate = [&](int i, int axis) -> real
+    {
+        return i == n ? 0.5*size[axis] : -0.5*size[axis] + i*d;
+    };
     std::vector<std::vector<int> > face_xp_points(n+1),
     face_xm_points(n+1),
     face_yp_points(n+1),
@@ -150,8 +230,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iz = 0; iz < n+1; ++iz)
         {
-            y = -0.5*size[1]+iy*d;
-            z = -0.5*size[2]+iz*d;
+            y = coordinate(iy, 1);
+            z = coordinate(iz, 2);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -169,8 +249,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iz = 0; iz < n+1; ++iz)
         {
-            y = -0.5*size[1]+iy*d;
-            z = -0.5*size[2]+iz*d;
+            y = coordinate(iy, 1);
+            z = coordinate(iz, 2);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -188,8 +268,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iz = 0; iz < n+1; ++iz)
         {
-            x = -0.5*size[0]+ix*d;
-            z = -0.5*size[2]+iz*d;
+            x = coordinate(ix, 0);
+            z = coordinate(iz, 2);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -205,8 +285,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iz = 0; iz < n+1; ++iz)
         {
-            x = -0.5*size[0]+ix*d;
-            z = -0.5*size[2]+iz*d;
+            x = coordinate(ix, 0);
+            z = coordinate(iz, 2);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -222,8 +302,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iy = 1; iy < n; ++iy)
         {
-            x = -0.5*size[0]+ix*d;
-            y = -0.5*size[1]+iy*d;
+            x = coordinate(ix, 0);
+            y = coordinate(iy, 1);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -237,8 +317,8 @@ void Tetralizer::build_boundary_mesh(std::vector<real>& points_boundary, real d,
     {
         for (int iy = 1; iy < n; ++iy)
         {
-            x = -0.5*size[0]+ix*d;
-            y = -0.5*size[1]+iy*d;
+            x = coordinate(ix, 0);
+            y = coordinate(iy, 1);
             points_boundary.push_back(x);
             points_boundary.push_back(y);
             points_boundary.push_back(z);
@@ -308,7 +388,7 @@ void Tetralizer::tetrahedralize_inside(const std::vector<real>& points_interface
     in.mesh_dim = 3;
     
     in.numberofpoints = (int)(points_interface.size()/3);
-    in.pointlist = new real[points_interface.size()];
+    in.pointlist = new REAL[points_interface.size()];
     
     for (unsigned int i = 0; i < points_interface.size(); ++i)
     {
@@ -348,7 +428,79 @@ void Tetralizer::tetrahedralize_inside(const std::vector<real>& points_interface
     }
 }
 
-void Tetralizer::tetrahedralize_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_boundary, std::vector<int>&  faces_boundary, std::vector<real>& points_outside, std::vector<int>& tets_outside, const vec3& inside_pts)
+bool Tetralizer::tetralize_cavity(std::vector<vec3>& points, const std::vector<int>& faces, std::vector<int>& tets)
+{
+    tetgenio in, out;
+    
+    in.firstnumber = 0;
+    in.mesh_dim = 3;
+    
+    in.numberofpoints = (int)points.size();
+    in.pointlist = new REAL[3*points.size()];
+    for (unsigned int i = 0; i < points.size(); ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            in.pointlist[3*i+j] = points[i][j];
+    }
+    
+    in.numberoffacets = (int)(faces.size()/3);
+    in.facetlist = new tetgenio::facet[in.numberoffacets];
+    
+    for (int i = 0; i < in.numberoffacets; ++i)
+    {
+        tetgenio::facet* f = &in.facetlist[i];
+        f->numberofpolygons = 1;
+        f->polygonlist = new tetgenio::polygon[f->numberofpolygons];
+        f->numberofholes = 0;
+        f->holelist = NULL;
+        tetgenio::polygon* p = &(f->polygonlist[0]);
+        p->numberofvertices = 3;
+        p->vertexlist = new int[p->numberofvertices];
+        for (int j = 0; j < p->numberofvertices; ++j)
+            p->vertexlist[j] = faces[3*i+j];
+    }
+    
+    try {
+        tetrahedralize(cavity_tetgen_flags, &in, &out);
+    }
+    catch (int) {
+        return false;
+    }
+    
+    // TetGen keeps the input points first and appends the added points.
+    for (int i = (int)points.size(); i < out.numberofpoints; ++i)
+    {
+        points.push_back(vec3(out.pointlist[3*i], out.pointlist[3*i+1], out.pointlist[3*i+2]));
+    }
+    
+    tets.resize(4 * out.numberoftetrahedra);
+    for (unsigned int i = 0; i < tets.size(); ++i)
+    {
+        tets[i] = out.tetrahedronlist[i];
+    }
+    return true;
+}
+
+real Tetralizer::boundary_edge_length(const vec3& size, real avg_edge_length, real grading, const std::vector<real>& points_interface)
+{
+    if(grading <= 0.)
+    {
+        return avg_edge_length;
+    }
+#ifdef DEBUG
+    assert(size[0] == size[1] && size[0] == size[2]); // The boundary mesh is a cube with the same number of edges along each side (see build_boundary_mesh).
+#endif
+    set_sizing(points_interface, avg_edge_length, grading);
+    real d = INFINITY;
+    for (int i = 0; i < 3; i++)
+    {
+        d = Util::min(d, get_edge_length(vec3(i == 0 ? -0.5*size[0] : 0., i == 1 ? -0.5*size[1] : 0., i == 2 ? -0.5*size[2] : 0.)));
+        d = Util::min(d, get_edge_length(vec3(i == 0 ? 0.5*size[0] : 0., i == 1 ? 0.5*size[1] : 0., i == 2 ? 0.5*size[2] : 0.)));
+    }
+    return size[0]/std::ceil(size[0]/d);
+}
+
+void Tetralizer::tetrahedralize_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_boundary, std::vector<int>&  faces_boundary, std::vector<real>& points_outside, std::vector<int>& tets_outside, const vec3& inside_pts, real avg_edge_length, real grading)
 {
     tetgenio in, out;
     
@@ -356,7 +508,7 @@ void Tetralizer::tetrahedralize_outside(const std::vector<real>& points_interfac
     in.mesh_dim = 3;
     
     in.numberofpoints = (int)(points_interface.size()/3+points_boundary.size()/3);
-    in.pointlist = new real[points_interface.size()+points_boundary.size()];
+    in.pointlist = new REAL[points_interface.size()+points_boundary.size()];
     for (unsigned int i = 0; i < points_interface.size(); ++i)
         in.pointlist[i] = points_interface[i];
     for (unsigned int i = points_interface.size(); i < points_interface.size()+points_boundary.size(); ++i)
@@ -386,11 +538,17 @@ void Tetralizer::tetrahedralize_outside(const std::vector<real>& points_interfac
     }
     
     in.numberofholes = 1;
-    in.holelist = new real[3*in.numberofholes];
+    in.holelist = new REAL[3*in.numberofholes];
     in.holelist[0] = inside_pts[0];
     in.holelist[1] = inside_pts[1];
     in.holelist[2] = inside_pts[2];
     
+    if(grading > 0.)
+    {
+        set_sizing(points_interface, avg_edge_length, grading);
+        in.tetunsuitable = is_too_large;
+    }
+    
     tetrahedralize(tetgen_flags, &in, &out);
     
     points_outside.resize(3*out.numberofpoints);
@@ -404,24 +562,24 @@ void Tetralizer::tetrahedralize_outside(const std::vector<real>& points_interfac
     }
 }
 
-void Tetralizer::merge_inside_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_inside, std::vector<int>&  tets_inside, std::vector<real>& points_outside, std::vector<int>&  tets_outside, std::vector<real>& output_points, std::vector<int>&  output_tets, std::vector<int>&  output_tet_flags)
+void Tetralizer::merge_inside_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_inside, std::vector<int>&  tets_inside, std::vector<real>& points_outside, std::vector<int>&  tets_outside, std::vector<vec3>& output_points, std::vector<int>&  output_tets, std::vector<int>&  output_tet_flags)
 {
     int no_interface_points = static_cast<int>(points_interface.size()/3);
     int no_outside_points = static_cast<int>(points_outside.size()/3);
     
-    output_points.resize(points_outside.size() + points_inside.size() - points_interface.size());
+    output_points.resize((points_outside.size() + points_inside.size() - points_interface.size())/3);
     output_tets.resize(tets_inside.size() + tets_outside.size());
     output_tet_flags.resize(output_tets.size()/4);
     
     unsigned int ip, it;
-    for (ip = 0; ip < points_outside.size(); ++ip)
+    for (ip = 0; ip < points_outside.size()/3; ++ip)
     {
-        output_points[ip] = points_outside[ip];
+        output_points[ip] = vec3(points_outside[3*ip], points_outside[3*ip+1], points_outside[3*ip+2]);
     }
-    int i = 0;
-    for (; ip < output_points.size(); ++ip, ++i)
+    unsigned int i = static_cast<unsigned int>(points_interface.size());
+    for (; ip < output_points.size(); ++ip, i += 3)
     {
-        output_points[ip] = points_inside[points_interface.size() + i];
+        output_points[ip] = vec3(points_inside[i], points_inside[i+1], points_inside[i+2]);
     }
     
     for (it = 0; it < tets_outside.size(); ++it)
@@ -17,12 +17,20 @@
 #pragma once
 
 #include "util.h"
+#include "mesh_io.h"
+
+#include <functional>
 
 class Tetralizer
 {
-    static void tetralize_cube1(int i, int j, int k, int Ni, int Nj, int Nk, std::vector<int>& tets);
+    /**
+     * Splits the range [0, N) into slabs and calls function(begin, end) for each slab on a separate thread.
+     */
+    static void parallel_for_slabs(int N, const std::function<void(int, int)>& function);
+    
+    static void tetralize_cube1(int i, int j, int k, int Ni, int Nj, int Nk, int* tets);
     
-    static void tetralize_cube2(int i, int j, int k, int Ni, int Nj, int Nk, std::vector<int>& tets);
+    static void tetralize_cube2(int i, int j, int k, int Ni, int Nj, int Nk, int* tets);
     
     static void create_tets(int Ni, int Nj, int Nk, std::vector<int>& tets);
     
@@ -32,16 +40,25 @@ class Tetralizer
     
     static void tetrahedralize_inside(const std::vector<real>& points_interface, const std::vector<int>& faces_interface, std::vector<real>& points_inside, std::vector<int>& tets_inside);
     
-    static void tetrahedralize_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_boundary, std::vector<int>&  faces_boundary, std::vector<real>& points_outside, std::vector<int>& tets_outside, const vec3& inside_pts);
+    /**
+     * Returns the edge length of the boundary mesh. For a graded tetralization, this is the target edge length at the boundary point closest to the interface, adjusted such that the boundary edges divide the domain evenly. The domain must be a cube, since the boundary mesh has the same number of edges along each side.
+     */
+    static real boundary_edge_length(const vec3& size, real avg_edge_length, real grading, const std::vector<real>& points_interface);
+    
+    static void tetrahedralize_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_boundary, std::vector<int>&  faces_boundary, std::vector<real>& points_outside, std::vector<int>& tets_outside, const vec3& inside_pts, real avg_edge_length, real grading);
     
-    static void merge_inside_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_inside, std::vector<int>&  tets_inside, std::vector<real>& points_outside, std::vector<int>&  tets_outside, std::vector<real>& output_points, std::vector<int>&  output_tets, std::vector<int>&  output_tet_flags);
+    static void merge_inside_outside(const std::vector<real>& points_interface, const std::vector<int>&  faces_interface, std::vector<real>& points_inside, std::vector<int>&  tets_inside, std::vector<real>& points_outside, std::vector<int>&  tets_outside, std::vector<vec3>& output_points, std::vector<int>&  output_tets, std::vector<int>&  output_tet_flags);
     
 public:
     
-    static void tetralize(const vec3& size, real avg_edge_length, const std::vector<vec3>& points_interface, const std::vector<int>& faces_interface, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
+    /**
+     * Tetralizes a domain of the given size around the interface with the average edge length avg_edge_length. If grading is positive, the target edge length outside the interface grows by grading per unit distance from the interface, i.e. the tetrahedra far from the interface are much larger than those at the interface. This reduces the number of tetrahedra considerably for large domains.
+     */
+    static void tetralize(const vec3& size, real avg_edge_length, const std::vector<vec3>& points_interface, const std::vector<int>& faces_interface, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels, real grading = 0.)
     {
         std::vector<real> points_interface_real;
-        for (vec3 p : points_interface) {
+        points_interface_real.reserve(3*points_interface.size());
+        for (const vec3& p : points_interface) {
             points_interface_real.push_back(p[0]);
             points_interface_real.push_back(p[1]);
             points_interface_real.push_back(p[2]);
@@ -49,25 +66,60 @@ public:
         
         std::vector<real>    points_boundary;
         std::vector<int>  faces_boundary;
-        build_boundary_mesh(points_boundary, avg_edge_length, faces_boundary, size);
+        build_boundary_mesh(points_boundary, boundary_edge_length(size, avg_edge_length, grading, points_interface_real), faces_boundary, size);
         
         std::vector<real> points_inside;
         std::vector<int> tets_inside;
         tetrahedralize_inside(points_interface_real, faces_interface, points_inside, tets_inside);
         
+        // The hole is marked by the center of a tetrahedron inside the interface. A point of the interface itself is on both sides, so TetGen may remove the outside instead.
+        vec3 inside_pt(0.);
+        for (int i = 0; i < 4; i++)
+        {
+            inside_pt += 0.25*vec3(points_inside[3*tets_inside[i]], points_inside[3*tets_inside[i]+1], points_inside[3*tets_inside[i]+2]);
+        }
+        
         std::vector<real> points_outside;
         std::vector<int> tets_outside;
-        tetrahedralize_outside(points_interface_real, faces_interface, points_boundary, faces_boundary, points_outside, tets_outside, vec3(points_inside[0], points_inside[1], points_inside[2]));
+        tetrahedralize_outside(points_interface_real, faces_interface, points_boundary, faces_boundary, points_outside, tets_outside, inside_pt, avg_edge_length, grading);
 
-        std::vector<real> points_real;
-        merge_inside_outside(points_interface_real, faces_interface, points_inside, tets_inside, points_outside, tets_outside, points_real, tets, tet_labels);
+        merge_inside_outside(points_interface_real, faces_interface, points_inside, tets_inside, points_outside, tets_outside, points, tets, tet_labels);
+    }
+    
+    /**
+     * Tetralizes a domain of the given size around the surface mesh in the .obj file obj_file_name. The surface mesh is scaled to fit inside the domain.
+     */
+    static void tetralize(const vec3& size, real avg_edge_length, const std::string& obj_file_name, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels, real grading = 0.)
+    {
+        std::vector<vec3> points_interface;
+        std::vector<int> faces_interface;
+        is_mesh::import_surface_mesh(obj_file_name, points_interface, faces_interface);
         
-        points.resize(points_real.size()/3);
-        for (unsigned int i = 0; i < points_real.size()/3; i++) {
-            points[i] = vec3(points_real[i*3], points_real[i*3+1], points_real[i*3+2]);
+        tetralize(size, avg_edge_length, points_interface, faces_interface, points, tets, tet_labels, grading);
+    }
+    
+    /**
+     * Creates a simplicial complex of type dsc_type with the given discretization directly from the surface mesh in the .obj file obj_file_name. The tetralization is handed to the complex in memory instead of being exported to and imported from a .dsc file. The positions are scaled by scale before the complex is created.
+     */
+    template<typename dsc_type>
+    static dsc_type* create_complex(const std::string& obj_file_name, real discretization, real scale = 1., const vec3& size = vec3(3.), real avg_edge_length = 0.5, real grading = 0.)
+    {
+        std::vector<vec3> points;
+        std::vector<int> tets;
+        std::vector<int> tet_labels;
+        tetralize(size, avg_edge_length, obj_file_name, points, tets, tet_labels, grading);
+        
+        for (vec3& p : points) {
+            p *= scale;
         }
+        return new dsc_type(discretization, points, tets, tet_labels);
     }
     
+    /**
+     * Tetralizes the cavity bounded by the triangles faces (three indices into points each) by TetGen and returns the tetrahedra in tets (four indices into points each). Points may be added inside the cavity, but the boundary triangles are preserved. Returns false if TetGen fails. It can be passed to DeformableSimplicialComplex::set_cavity_tetralizer.
+     */
+    static bool tetralize_cavity(std::vector<vec3>& points, const std::vector<int>& faces, std::vector<int>& tets);
+    
     static void tetralize(const vec3& size, real avg_edge_length, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
     {
         int Ni = std::ceil(size[0]/avg_edge_length) + 1;
@@ -76,9 +128,20 @@ public:
         
         create_points(size, avg_edge_length, Ni, Nj, Nk, points);
         create_tets(Ni, Nj, Nk, tets);
+        tet_labels.assign(tets.size()/4, 0);
+    }
+    
+    /**
+     * Creates a simplicial complex of type dsc_type with the given discretization from a tetralization of a cube of the given size. The tetralization is handed directly to the complex and freed as soon as the complex is created.
+     */
+    template<typename dsc_type>
+    static dsc_type* create_complex(real discretization, const vec3& size, real avg_edge_length)
+    {
+        std::vector<vec3> points;
+        std::vector<int> tets;
+        std::vector<int> tet_labels;
+        tetralize(size, avg_edge_length, points, tets, tet_labels);
         
-        for (unsigned int i = 0; i < tets.size()/4; i++) {
-            tet_labels.push_back(0);
-        }
+        return new dsc_type(discretization, points, tets, tet_labels);
     }
 };
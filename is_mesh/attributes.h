@@ -99,17 +99,17 @@ namespace is_mesh {
         EdgeAttributes() {}
         
         
-        bool is_crossing()
+        bool is_crossing() const
         {
             return flags[2];
         }
         
-        bool is_boundary()
+        bool is_boundary() const
         {
             return flags[1];
         }
         
-        bool is_interface()
+        bool is_interface() const
         {
             return flags[0];
         }
@@ -137,12 +137,12 @@ namespace is_mesh {
     public:
         FaceAttributes() {}
         
-        bool is_boundary()
+        bool is_boundary() const
         {
             return flags[1];
         }
         
-        bool is_interface()
+        bool is_interface() const
         {
             return flags[0];
         }
@@ -165,7 +165,7 @@ namespace is_mesh {
     public:
         TetAttributes() {}
         
-        int label()
+        int label() const
         {
             return l;
         }
@@ -20,9 +20,104 @@
 #include "kernel.h"
 #include "simplex.h"
 #include "simplex_set.h"
+#include "trace.h"
+
+#include <array>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <thread>
 
 namespace is_mesh {
     
+    /**
+     * The memory usage of an ISMesh per kernel (see kernel_memory). The other bytes are used by derived classes, for example for caches.
+     */
+    struct MemoryUsage
+    {
+        kernel_memory nodes, edges, faces, tetrahedra;
+        size_t other_bytes = 0;
+        
+        /**
+         * Returns the reserved and heap bytes of the kernels plus the other bytes.
+         */
+        size_t total_bytes() const
+        {
+            return nodes.bytes_reserved + nodes.heap_bytes + edges.bytes_reserved + edges.heap_bytes + faces.bytes_reserved + faces.heap_bytes
+                + tetrahedra.bytes_reserved + tetrahedra.heap_bytes + other_bytes;
+        }
+    };
+    
+    /**
+     * The result of ISMesh::check_validity. For each check, the number of simplices which violate it, and a description of the first violations.
+     */
+    struct ValidityReport
+    {
+        enum Check {CONNECTIVITY, INVERSION, BOUNDARY, INTERFACE, NO_CHECKS};
+        
+        const static unsigned int MAX_MESSAGES = 20;
+        
+        std::array<unsigned int, NO_CHECKS> errors;
+        std::vector<std::string> messages;
+        
+        ValidityReport()
+        {
+            errors.fill(0);
+        }
+        
+        static std::string get_check_name(Check check)
+        {
+            switch (check) {
+                case CONNECTIVITY: return "connectivity of the simplicial complex";
+                case INVERSION: return "orientation of the tetrahedra";
+                case BOUNDARY: return "boundary flags";
+                case INTERFACE: return "interface flags";
+                default: return "";
+            }
+        }
+        
+        void add_error(Check check, const std::string& message)
+        {
+            errors[check]++;
+            if (messages.size() < MAX_MESSAGES)
+            {
+                messages.push_back(message);
+            }
+        }
+        
+        /**
+         * Adds the errors of another report, for example one computed by another thread.
+         */
+        void add(const ValidityReport& other)
+        {
+            for (unsigned int i = 0; i < NO_CHECKS; i++)
+            {
+                errors[i] += other.errors[i];
+            }
+            for (unsigned int i = 0; i < other.messages.size() && messages.size() < MAX_MESSAGES; i++)
+            {
+                messages.push_back(other.messages[i]);
+            }
+        }
+        
+        bool is_valid(Check check) const
+        {
+            return errors[check] == 0;
+        }
+        
+        bool is_valid() const
+        {
+            for (unsigned int e : errors)
+            {
+                if (e != 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+    
     template <typename node_traits, typename edge_traits, typename face_traits, typename tet_traits>
     class ISMesh
     {
@@ -37,18 +132,51 @@ namespace is_mesh {
         kernel<tetrahedron_type, TetrahedronKey>*           m_tetrahedron_kernel;
         
     public:
-        ISMesh(std::vector<vec3> & points, std::vector<int> & tets, const std::vector<int>& tet_labels)
+        ISMesh(const std::vector<vec3> & points, const std::vector<int> & tets, const std::vector<int>& tet_labels)
+        {
+            // Reserve memory according to the expected number of simplices (#edges ~ #nodes + #tets and #faces ~ 2 #tets) to avoid growing the kernels during creation.
+            size_t no_tets = tets.size()/4;
+            m_node_kernel = new kernel<node_type, NodeKey>(std::max<size_t>(points.size(), 64));
+            m_edge_kernel = new kernel<edge_type, EdgeKey>(std::max<size_t>(points.size() + no_tets + no_tets/8, 64));
+            m_face_kernel = new kernel<face_type, FaceKey>(std::max<size_t>(2*no_tets + no_tets/8, 64));
+            m_tetrahedron_kernel = new kernel<tetrahedron_type, TetrahedronKey>(std::max<size_t>(no_tets, 64));
+            
+            create(points, tets);
+            init_flags(tet_labels);
+            validity_check();
+        }
+        
+        /**
+         * Creates the mesh from a binary stream written by save_state. If the stream could not be read, an error is printed, the failbit of the
+         * stream is set and the mesh should not be used.
+         */
+        ISMesh(std::istream& is)
         {
             m_node_kernel = new kernel<node_type, NodeKey>();
             m_edge_kernel = new kernel<edge_type, EdgeKey>();
             m_face_kernel = new kernel<face_type, FaceKey>();
             m_tetrahedron_kernel = new kernel<tetrahedron_type, TetrahedronKey>();
             
-            create(points, tets);
-            init_flags(tet_labels);
-            validity_check();
+            if (!load_state(is))
+            {
+                std::cerr << "ERROR: The state of the mesh could not be read." << std::endl;
+            }
         }
         
+        /**
+         * Creates a copy of the mesh which shares the pages of the kernels with the given mesh until either of them changes them (see kernel).
+         * Copying is therefore proportional to the number of pages and not to the number of simplices.
+         */
+        ISMesh(const ISMesh& mesh)
+        {
+            m_node_kernel = new kernel<node_type, NodeKey>(*mesh.m_node_kernel);
+            m_edge_kernel = new kernel<edge_type, EdgeKey>(*mesh.m_edge_kernel);
+            m_face_kernel = new kernel<face_type, FaceKey>(*mesh.m_face_kernel);
+            m_tetrahedron_kernel = new kernel<tetrahedron_type, TetrahedronKey>(*mesh.m_tetrahedron_kernel);
+        }
+        
+        ISMesh& operator=(const ISMesh&) = delete;
+        
         ~ISMesh()
         {
             delete m_tetrahedron_kernel;
@@ -57,6 +185,51 @@ namespace is_mesh {
             delete m_node_kernel;
         }
         
+        ////////////////
+        // CHECKPOINT //
+        ////////////////
+    public:
+        /**
+         * Writes the whole state of the mesh to a binary stream, that is the kernels in their native layout including the marked and empty
+         * cells (see kernel::save). Unlike export_tet_mesh, the keys, the destinations of the nodes and the interface, boundary and crossing
+         * flags are kept, so load_state restores the mesh without rebuilding the connectivity or the flags.
+         */
+        void save_state(std::ostream& os) const
+        {
+            os.write(get_state_magic(), 8);
+            m_node_kernel->save(os);
+            m_edge_kernel->save(os);
+            m_face_kernel->save(os);
+            m_tetrahedron_kernel->save(os);
+        }
+        
+        /**
+         * Replaces the mesh by the state written by save_state. Returns false and sets the failbit of the stream if the stream could not be
+         * read or was written with other simplex types (for example in the other precision), in which case the mesh may be partly replaced
+         * and should not be used.
+         */
+        bool load_state(std::istream& is)
+        {
+            char magic[8];
+            is.read(magic, sizeof(magic));
+            bool loaded = is && memcmp(magic, get_state_magic(), sizeof(magic)) == 0
+                && m_node_kernel->load(is) && m_edge_kernel->load(is) && m_face_kernel->load(is) && m_tetrahedron_kernel->load(is);
+            if (!loaded)
+            {
+                is.setstate(std::ios::failbit);
+            }
+            return loaded;
+        }
+    
+    private:
+        /**
+         * Returns the 8 characters which identify the state written by save_state and its version.
+         */
+        static const char* get_state_magic()
+        {
+            return "ISMESH01";
+        }
+        
         ///////////////
         // ITERATORS //
         ///////////////
@@ -115,25 +288,25 @@ namespace is_mesh {
         template<typename key>
         void set_interface(const key& k, bool b)
         {
-            return get(k).set_interface(b);
+            return get_mutable(k).set_interface(b);
         }
         
         template<typename key>
         void set_boundary(const key& k, bool b)
         {
-            return get(k).set_boundary(b);
+            return get_mutable(k).set_boundary(b);
         }
         
         template<typename key>
         void set_crossing(const key& k, bool b)
         {
-            return get(k).set_crossing(b);
+            return get_mutable(k).set_crossing(b);
         }
         
     public:
         void set_label(const TetrahedronKey& tid, int label)
         {
-            get(tid).label(label);
+            get_mutable(tid).label(label);
             SimplexSet<TetrahedronKey> tids = {tid};
             update(tids);
         }
@@ -199,7 +372,7 @@ namespace is_mesh {
             std::map<edge_key, int> edge_map;
             std::map<face_key, int> face_map;
             
-            for (vec3 p : points)
+            for (const vec3& p : points)
             {
                 insert_node(p);
             }
@@ -241,7 +414,7 @@ namespace is_mesh {
             {
                 for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
                 {
-                    tit->label(tet_labels[tit.key()]);
+                    get_mutable(tit.key()).label(tet_labels[tit.key()]);
                 }
             }
             
@@ -422,22 +595,49 @@ namespace is_mesh {
         // GETTER FUNCTIONS //
         //////////////////////
     public:
-        node_type & get(const NodeKey& nid)
+        /**
+         * Returns the simplex for reading. Use get_mutable to change it.
+         */
+        const node_type & get(const NodeKey& nid) const
+        {
+            return m_node_kernel->find_const(nid);
+        }
+        
+        const edge_type & get(const EdgeKey& eid) const
+        {
+            return m_edge_kernel->find_const(eid);
+        }
+        
+        const face_type & get(const FaceKey& fid) const
+        {
+            return m_face_kernel->find_const(fid);
+        }
+        
+        const tetrahedron_type & get(const TetrahedronKey& tid) const
+        {
+            return m_tetrahedron_kernel->find_const(tid);
+        }
+        
+        /**
+         * Returns the simplex for modification. If the simplex is shared with a fork of the mesh, the page of the kernel which holds it is
+         * copied first (see kernel::find), so references to simplices in the same page which were returned by get may become stale.
+         */
+        node_type & get_mutable(const NodeKey& nid)
         {
             return m_node_kernel->find(nid);
         }
         
-        edge_type & get(const EdgeKey& eid)
+        edge_type & get_mutable(const EdgeKey& eid)
         {
             return m_edge_kernel->find(eid);
         }
         
-        face_type & get(const FaceKey& fid)
+        face_type & get_mutable(const FaceKey& fid)
         {
             return m_face_kernel->find(fid);
         }
         
-        tetrahedron_type & get(const TetrahedronKey& tid)
+        tetrahedron_type & get_mutable(const TetrahedronKey& tid)
         {
             return m_tetrahedron_kernel->find(tid);
         }
@@ -815,10 +1015,9 @@ namespace is_mesh {
                 {
                     SimplexSet<NodeKey> nids = get_nodes(f);
                     SimplexSet<NodeKey> apices = get_nodes(tids) - nids;
-                    auto normal = cross(get_pos(nids[0]) - get_pos(nids[2]), get_pos(nids[1]) - get_pos(nids[2]));
-                    auto d1 = dot(get_pos(apices[0]) - get_pos(nids[2]), normal);
-                    auto d2 = dot(get_pos(apices[1]) - get_pos(nids[2]), normal);
-                    if((d1 < 0. && d2 < 0) || (d1 > 0. && d2 > 0.))
+                    double d1 = Util::orient3d(get_pos(apices[0]), get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]));
+                    double d2 = Util::orient3d(get_pos(apices[1]), get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]));
+                    if((d1 < 0. && d2 < 0.) || (d1 > 0. && d2 > 0.))
                     {
                         return true;
                     }
@@ -850,11 +1049,11 @@ namespace is_mesh {
         {
             auto edge = m_edge_kernel->create(edge_traits());
             //add the new simplex to the co-boundary relation of the boundary simplices
-            get(node1).add_co_face(edge.key());
-            get(node2).add_co_face(edge.key());
+            get_mutable(node1).add_co_face(edge.key());
+            get_mutable(node2).add_co_face(edge.key());
             //set the boundary relation
-            edge->add_face(node1);
-            edge->add_face(node2);
+            get_mutable(edge.key()).add_face(node1);
+            get_mutable(edge.key()).add_face(node2);
             return edge.key();
         }
         
@@ -866,12 +1065,12 @@ namespace is_mesh {
         {
             auto face = m_face_kernel->create(face_traits());
             //update relations
-            get(edge1).add_co_face(face.key());
-            get(edge2).add_co_face(face.key());
-            get(edge3).add_co_face(face.key());
-            face->add_face(edge1);
-            face->add_face(edge2);
-            face->add_face(edge3);
+            get_mutable(edge1).add_co_face(face.key());
+            get_mutable(edge2).add_co_face(face.key());
+            get_mutable(edge3).add_co_face(face.key());
+            get_mutable(face.key()).add_face(edge1);
+            get_mutable(face.key()).add_face(edge2);
+            get_mutable(face.key()).add_face(edge3);
             return face.key();
         }
         
@@ -883,14 +1082,14 @@ namespace is_mesh {
         {
             auto tetrahedron = m_tetrahedron_kernel->create(tet_traits());
             //update relations
-            get(face1).add_co_face(tetrahedron.key());
-            get(face2).add_co_face(tetrahedron.key());
-            get(face3).add_co_face(tetrahedron.key());
-            get(face4).add_co_face(tetrahedron.key());
-            tetrahedron->add_face(face1);
-            tetrahedron->add_face(face2);
-            tetrahedron->add_face(face3);
-            tetrahedron->add_face(face4);
+            get_mutable(face1).add_co_face(tetrahedron.key());
+            get_mutable(face2).add_co_face(tetrahedron.key());
+            get_mutable(face3).add_co_face(tetrahedron.key());
+            get_mutable(face4).add_co_face(tetrahedron.key());
+            get_mutable(tetrahedron.key()).add_face(face1);
+            get_mutable(tetrahedron.key()).add_face(face2);
+            get_mutable(tetrahedron.key()).add_face(face3);
+            get_mutable(tetrahedron.key()).add_face(face4);
             
             return tetrahedron.key();
         }
@@ -903,7 +1102,7 @@ namespace is_mesh {
         {
             for(auto e : get_edges(nid))
             {
-                get(e).remove_face(nid);
+                get_mutable(e).remove_face(nid);
             }
             m_node_kernel->erase(nid);
         }
@@ -915,11 +1114,11 @@ namespace is_mesh {
         {
             for(auto f : get_faces(eid))
             {
-                get(f).remove_face(eid);
+                get_mutable(f).remove_face(eid);
             }
             for(auto n : get_nodes(eid))
             {
-                get(n).remove_co_face(eid);
+                get_mutable(n).remove_co_face(eid);
             }
             m_edge_kernel->erase(eid);
         }
@@ -931,11 +1130,11 @@ namespace is_mesh {
         {
             for(auto t : get_tets(fid))
             {
-                get(t).remove_face(fid);
+                get_mutable(t).remove_face(fid);
             }
             for(auto e : get_edges(fid))
             {
-                get(e).remove_co_face(fid);
+                get_mutable(e).remove_co_face(fid);
             }
             m_face_kernel->erase(fid);
         }
@@ -947,7 +1146,7 @@ namespace is_mesh {
         {
             for(auto f : get_faces(tid))
             {
-                get(f).remove_co_face(tid);
+                get_mutable(f).remove_co_face(tid);
             }
             m_tetrahedron_kernel->erase(tid);
         }
@@ -965,15 +1164,15 @@ namespace is_mesh {
         template<typename child_key, typename parent_key>
         void connect(const child_key& ck, const parent_key& pk)
         {
-            get(ck).add_co_face(pk);
-            get(pk).add_face(ck);
+            get_mutable(ck).add_co_face(pk);
+            get_mutable(pk).add_face(ck);
         }
         
         template<typename child_key, typename parent_key>
         void disconnect(const child_key& ck, const parent_key& pk)
         {
-            get(ck).remove_co_face(pk);
-            get(pk).remove_face(ck);
+            get_mutable(ck).remove_co_face(pk);
+            get_mutable(pk).remove_face(ck);
         }
         
         template<typename child_key, typename parent_key>
@@ -1031,7 +1230,7 @@ namespace is_mesh {
             
             // Split edge
             auto new_nid = insert_node(pos);
-            get(new_nid).set_destination(destination);
+            get_mutable(new_nid).set_destination(destination);
             
             disconnect(nids[1], eid);
             connect(new_nid, eid);
@@ -1080,8 +1279,8 @@ namespace is_mesh {
         
         virtual void update_collapse(const NodeKey& nid, const NodeKey& nid_removed, real weight)
         {
-            Node<node_traits>& node = get(nid);
-            Node<node_traits>& node_removed = get(nid_removed);
+            Node<node_traits>& node = get_mutable(nid);
+            Node<node_traits>& node_removed = get_mutable(nid_removed);
             node.set_pos((1.-weight) * node.get_pos() + weight * node_removed.get_pos());
             node.set_destination((1.-weight) * node.get_destination() + weight * node_removed.get_destination());
         }
@@ -1344,13 +1543,168 @@ namespace is_mesh {
             flip(eid[0], fid1, fid2);
         }
         
+        /**
+         * Replaces the tetrahedra tids, which must have the same label, by the tetrahedra tets which are given by four indices into nids each.
+         * The boundary of the new tetrahedra must coincide with the boundary of tids. Returns the new tetrahedra.
+         */
+        SimplexSet<TetrahedronKey> replace(const SimplexSet<TetrahedronKey>& tids, const std::vector<NodeKey>& nids, const std::vector<int>& tets)
+        {
+            return replace(tids, nids, tets, std::vector<int>(tets.size()/4, get_label(tids.front())));
+        }
+        
+        /**
+         * Replaces the tetrahedra tids by the tetrahedra tets which are given by four indices into nids each and have the labels labels.
+         * The new tetrahedra must fill the same region as tids. The edges and faces of tids are reused by the new tetrahedra when they have the same nodes,
+         * and the nodes, edges and faces which are no longer part of a tetrahedron are removed. tids is any container of tetrahedron keys. Returns the new tetrahedra.
+         */
+        template<typename tet_set_type>
+        SimplexSet<TetrahedronKey> replace(const tet_set_type& tids, const std::vector<NodeKey>& nids, const std::vector<int>& tets, const std::vector<int>& labels)
+        {
+            std::vector<FaceKey> fids = get_sorted_boundary<FaceKey>(tids);
+            std::vector<EdgeKey> eids = get_sorted_boundary<EdgeKey>(fids);
+            std::vector<NodeKey> old_nids = get_sorted_boundary<NodeKey>(eids);
+            
+            // The new tetrahedra can only share edges and faces with the old ones, so these are looked up by their sorted nodes.
+            std::map<edge_key, EdgeKey> edge_map;
+            std::map<face_key, FaceKey> face_map;
+            for (auto e : eids)
+            {
+                const SimplexSet<NodeKey>& e_nids = get_nodes(e);
+                edge_map[edge_key(std::min(e_nids[0], e_nids[1]), std::max(e_nids[0], e_nids[1]))] = e;
+            }
+            for (auto f : fids)
+            {
+                SimplexSet<NodeKey> f_nids = get_nodes(f);
+                unsigned int n[3] = {f_nids[0], f_nids[1], f_nids[2]};
+                std::sort(n, n+3);
+                face_map[face_key(n[0], n[1], n[2])] = f;
+            }
+            
+            for (auto t : tids)
+            {
+                remove(t);
+            }
+            
+            // Create the new tetrahedra
+            SimplexSet<TetrahedronKey> new_tids;
+            for (unsigned int i = 0; i + 3 < tets.size(); i += 4)
+            {
+                NodeKey t_nids[4] = {nids[tets[i]], nids[tets[i+1]], nids[tets[i+2]], nids[tets[i+3]]};
+                std::sort(t_nids, t_nids+4);
+                EdgeKey t_eids[4][4];
+                for (int a = 0; a < 4; a++)
+                {
+                    for (int b = a + 1; b < 4; b++)
+                    {
+                        auto it = edge_map.insert(std::make_pair(edge_key(t_nids[a], t_nids[b]), EdgeKey()));
+                        if (it.second)
+                        {
+                            it.first->second = insert_edge(t_nids[a], t_nids[b]);
+                        }
+                        t_eids[a][b] = t_eids[b][a] = it.first->second;
+                    }
+                }
+                FaceKey t_fids[4];
+                for (int a = 0; a < 4; a++)
+                {
+                    // The face opposite to the node a
+                    int b = a == 0 ? 1 : 0, c = a <= 1 ? 2 : 1, d = a <= 2 ? 3 : 2;
+                    auto it = face_map.insert(std::make_pair(face_key(t_nids[b], t_nids[c], t_nids[d]), FaceKey()));
+                    if (it.second)
+                    {
+                        it.first->second = insert_face(t_eids[b][c], t_eids[c][d], t_eids[d][b]);
+                    }
+                    t_fids[a] = it.first->second;
+                }
+                new_tids.push_back(insert_tetrahedron(t_fids[0], t_fids[1], t_fids[2], t_fids[3]));
+            }
+            
+            // Remove the simplices which are no longer part of a tetrahedron
+            for (auto f : fids)
+            {
+                if (get_tets(f).size() == 0)
+                {
+                    remove(f);
+                }
+            }
+            for (auto e : eids)
+            {
+                if (get_faces(e).size() == 0)
+                {
+                    remove(e);
+                }
+            }
+            for (auto n : old_nids)
+            {
+                if (get_edges(n).size() == 0)
+                {
+                    remove(n);
+                }
+            }
+            
+            // Update flags
+            for (unsigned int i = 0; i < new_tids.size(); i++)
+            {
+                get_mutable(new_tids[i]).label(labels[i]);
+            }
+            std::vector<FaceKey> new_fids = get_sorted_boundary<FaceKey>(new_tids);
+            std::vector<EdgeKey> new_eids = get_sorted_boundary<EdgeKey>(new_fids);
+            for (auto f : new_fids)
+            {
+                update_flag(f);
+            }
+            for (auto e : new_eids)
+            {
+                update_flag(e);
+            }
+            for (auto n : get_sorted_boundary<NodeKey>(new_eids))
+            {
+                update_flag(n);
+            }
+            return new_tids;
+        }
+        
+    private:
+        /**
+         * Returns the simplices in the boundary of the simplices keys sorted and without duplicates. Unlike the SimplexSet unions,
+         * this is not quadratic in the number of simplices.
+         */
+        template<typename key_type, typename container_type>
+        std::vector<key_type> get_sorted_boundary(const container_type& keys)
+        {
+            std::vector<key_type> result;
+            for (auto k : keys)
+            {
+                const SimplexSet<key_type>& boundary = get(k).get_boundary();
+                result.insert(result.end(), boundary.begin(), boundary.end());
+            }
+            std::sort(result.begin(), result.end());
+            result.erase(std::unique(result.begin(), result.end()), result.end());
+            return result;
+        }
+        
         ///////////////////////
         // UTILITY FUNCTIONS //
         ///////////////////////
     public:
         
+        /**
+         * Returns the memory used by the kernels and the simplices. Runs in linear time in the capacity of the kernels, or in constant time
+         * without the heap bytes of the simplices if scan is false (see kernel::memory).
+         */
+        virtual MemoryUsage get_memory_usage(bool scan = true) const
+        {
+            MemoryUsage m;
+            m.nodes = m_node_kernel->memory(scan);
+            m.edges = m_edge_kernel->memory(scan);
+            m.faces = m_face_kernel->memory(scan);
+            m.tetrahedra = m_tetrahedron_kernel->memory(scan);
+            return m;
+        }
+        
         void garbage_collect()
         {
+            Util::Trace::Scope trace("garbage collect");
             m_node_kernel->garbage_collect();
             m_edge_kernel->garbage_collect();
             m_face_kernel->garbage_collect();
@@ -1360,135 +1714,465 @@ namespace is_mesh {
         virtual void scale(const vec3& s)
         {
             for (auto nit = nodes_begin(); nit != nodes_end(); nit++) {
-                nit->set_pos(s*nit->get_pos());
-                nit->set_destination(s*nit->get_destination());
+                get_mutable(nit.key()).set_pos(s*nit->get_pos());
+                get_mutable(nit.key()).set_destination(s*nit->get_destination());
             }
         }
         
+        /**
+         * Returns the number of points and faces which extract_surface_mesh outputs, for example to allocate the buffers which are given to it.
+         */
+        void get_surface_mesh_size(size_t& no_points, size_t& no_faces)
+        {
+            std::vector<size_t> node_counts, face_counts;
+            count_valid(*m_node_kernel, node_counts, [this](const NodeKey& n) { return get(n).is_interface(); });
+            count_valid(*m_face_kernel, face_counts, [this](const FaceKey& f) { return get(f).is_interface(); });
+            no_points = node_counts.back();
+            no_faces = face_counts.back();
+        }
+        
+        /**
+         * Returns the number of points and tetrahedra which extract_tet_mesh outputs, for example to allocate the buffers which are given to it.
+         */
+        void get_tet_mesh_size(size_t& no_points, size_t& no_tets)
+        {
+            no_points = m_node_kernel->size();
+            no_tets = m_tetrahedron_kernel->size();
+        }
+        
+        /**
+         * Extracts the interface as a triangle mesh with zero-based indices into points. The faces are oriented away from the tetrahedron with the
+         * largest label. The vectors are resized to get_surface_mesh_size.
+         */
         void extract_surface_mesh(std::vector<vec3>& points, std::vector<int>& faces)
         {
-            garbage_collect();
+            size_t no_points, no_faces;
+            get_surface_mesh_size(no_points, no_faces);
+            points.resize(no_points);
+            faces.resize(3*no_faces);
+            extract_surface_mesh(points.data(), faces.data());
+        }
+        
+        /**
+         * Extracts the interface into caller-provided buffers, for example memory mapped files, which have room for the number of points and
+         * three indices per face given by get_surface_mesh_size. The simplices are output in the order of their keys. The index of each node is
+         * computed with a prefix sum over the node kernel and stored in a dense array, and the kernels are split between the hardware threads.
+         */
+        void extract_surface_mesh(vec3* points, int* faces)
+        {
+            Util::Trace::Scope trace("extract surface mesh");
+            auto is_interface_node = [this](const NodeKey& n) { return get(n).is_interface(); };
+            auto is_interface_face = [this](const FaceKey& f) { return get(f).is_interface(); };
+            std::vector<size_t> node_offsets, face_offsets;
+            count_valid(*m_node_kernel, node_offsets, is_interface_node);
+            count_valid(*m_face_kernel, face_offsets, is_interface_face);
             
-            std::map<NodeKey, int> indices;
-            // Extract vertices
-            for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+            std::vector<int> indices(m_node_kernel->capacity(), -1);
+            for_each_valid(*m_node_kernel, node_offsets, is_interface_node, [&](const NodeKey& n, size_t i) {
+                points[i] = get_pos(n);
+                indices[n] = static_cast<int>(i);
+            });
+            for_each_valid(*m_face_kernel, face_offsets, is_interface_face, [&](const FaceKey& f, size_t i) {
+                auto nids = get_sorted_nodes(f);
+                for (unsigned int j = 0; j < 3; j++)
+                {
+                    faces[3*i + j] = indices[nids[j]];
+                }
+            });
+        }
+        
+        /**
+         * Extracts the tetrahedral mesh with zero-based indices into points. The vectors are resized to get_tet_mesh_size.
+         */
+        void extract_tet_mesh(std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
+        {
+            size_t no_points, no_tets;
+            get_tet_mesh_size(no_points, no_tets);
+            points.resize(no_points);
+            tets.resize(4*no_tets);
+            tet_labels.resize(no_tets);
+            extract_tet_mesh(points.data(), tets.data(), tet_labels.data());
+        }
+        
+        /**
+         * Extracts the tetrahedral mesh into caller-provided buffers, for example memory mapped files, which have room for the number of points,
+         * four indices per tetrahedron and the labels given by get_tet_mesh_size. See extract_surface_mesh.
+         */
+        void extract_tet_mesh(vec3* points, int* tets, int* tet_labels)
+        {
+            Util::Trace::Scope trace("extract tet mesh");
+            auto all_nodes = [](const NodeKey&) { return true; };
+            auto all_tets = [](const TetrahedronKey&) { return true; };
+            std::vector<size_t> node_offsets, tet_offsets;
+            count_valid(*m_node_kernel, node_offsets, all_nodes);
+            count_valid(*m_tetrahedron_kernel, tet_offsets, all_tets);
+            
+            std::vector<int> indices(m_node_kernel->capacity(), -1);
+            for_each_valid(*m_node_kernel, node_offsets, all_nodes, [&](const NodeKey& n, size_t i) {
+                points[i] = get_pos(n);
+                indices[n] = static_cast<int>(i);
+            });
+            for_each_valid(*m_tetrahedron_kernel, tet_offsets, all_tets, [&](const TetrahedronKey& t, size_t i) {
+                auto nids = get_nodes(t);
+                for (unsigned int j = 0; j < 4; j++)
+                {
+                    tets[4*i + j] = indices[nids[j]];
+                }
+                tet_labels[i] = get_label(t);
+            });
+        }
+        
+        /**
+         * Checks the connectivity of the simplicial complex, that no tetrahedra are inverted and that the boundary and interface flags match the
+         * mesh. Each simplex is checked once against its boundary and co-boundary. The kernels are split into one range per hardware thread and
+         * each thread accumulates its own report, so the mesh must not change during the check.
+         */
+        ValidityReport check_validity()
+        {
+            Util::Trace::Scope scope("validity check");
+            unsigned int no_threads = get_no_threads();
+            std::vector<ValidityReport> reports(no_threads);
+            parallel_for_threads(no_threads, [this, no_threads, &reports](unsigned int thread) {
+                ValidityReport& report = reports[thread];
+                for_each_in_range(*m_node_kernel, thread, no_threads, [&](const NodeKey& n) { check(n, report); });
+                for_each_in_range(*m_edge_kernel, thread, no_threads, [&](const EdgeKey& e) { check(e, report); });
+                for_each_in_range(*m_face_kernel, thread, no_threads, [&](const FaceKey& f) { check(f, report); });
+                for_each_in_range(*m_tetrahedron_kernel, thread, no_threads, [&](const TetrahedronKey& t) { check(t, report); });
+            });
+            
+            ValidityReport report;
+            for (auto& r : reports)
+            {
+                report.add(r);
+            }
+            return report;
+        }
+        
+        /**
+         * Prints the result of check_validity and asserts that the mesh is valid.
+         */
+        void validity_check()
+        {
+            ValidityReport report = check_validity();
+            for (unsigned int i = 0; i < ValidityReport::NO_CHECKS; i++)
             {
-                if (nit->is_interface())
+                auto check = static_cast<typename ValidityReport::Check>(i);
+                std::cout << "Checking " << ValidityReport::get_check_name(check) << ": ";
+                if (report.is_valid(check))
                 {
-                    points.push_back(nit->get_pos());
-                    indices[nit.key()] = static_cast<int>(points.size());
+                    std::cout << "PASSED" << std::endl;
+                }
+                else {
+                    std::cout << "FAILED (" << report.errors[check] << " errors)" << std::endl;
                 }
             }
-            
-            // Extract faces
-            for (auto fit = faces_begin(); fit != faces_end(); fit++)
+            for (auto& message : report.messages)
             {
-                if (fit->is_interface())
+                std::cout << message << std::endl;
+            }
+            assert(report.is_valid());
+        }
+        
+    private:
+        
+        /**
+         * Calls function(thread) for each of the no_threads threads in parallel and waits for them to finish.
+         */
+        template<typename Function>
+        static void parallel_for_threads(unsigned int no_threads, Function function)
+        {
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < no_threads; t++)
+            {
+                threads.push_back(std::thread(function, t));
+            }
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+        
+        static unsigned int get_no_threads()
+        {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+        
+        /**
+         * Calls function(key) for each valid simplex whose key is in the thread's part of the kernel.
+         */
+        template<typename value_type, typename key_type, typename Function>
+        static void for_each_in_range(kernel<value_type, key_type>& simplex_kernel, unsigned int thread, unsigned int no_threads, Function function)
+        {
+            size_t capacity = simplex_kernel.capacity();
+            for (size_t i = (thread*capacity)/no_threads; i < ((thread+1)*capacity)/no_threads; i++)
+            {
+                key_type k(static_cast<unsigned int>(i));
+                if (simplex_kernel.is_valid(k))
                 {
-                    for (auto &n : get_sorted_nodes(fit.key()))
+                    function(k);
+                }
+            }
+        }
+        
+        /**
+         * Counts the valid simplices for which predicate is true in each thread's part of the kernel. On return, offsets[t] is the number of
+         * such simplices before the part of thread t and offsets.back() is the total.
+         */
+        template<typename value_type, typename key_type, typename Predicate>
+        static void count_valid(kernel<value_type, key_type>& simplex_kernel, std::vector<size_t>& offsets, Predicate predicate)
+        {
+            unsigned int no_threads = get_no_threads();
+            offsets.assign(no_threads + 1, 0);
+            parallel_for_threads(no_threads, [&](unsigned int thread) {
+                size_t count = 0;
+                for_each_in_range(simplex_kernel, thread, no_threads, [&](const key_type& k) {
+                    if (predicate(k))
                     {
-                        faces.push_back(indices[n]);
+                        count++;
                     }
+                });
+                offsets[thread + 1] = count;
+            });
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        }
+        
+        /**
+         * Calls function(key, index) for each valid simplex for which predicate is true, where index is its position in key order among those
+         * simplices. The offsets are computed by count_valid.
+         */
+        template<typename value_type, typename key_type, typename Predicate, typename Function>
+        static void for_each_valid(kernel<value_type, key_type>& simplex_kernel, const std::vector<size_t>& offsets, Predicate predicate, Function function)
+        {
+            unsigned int no_threads = static_cast<unsigned int>(offsets.size() - 1);
+            parallel_for_threads(no_threads, [&](unsigned int thread) {
+                size_t index = offsets[thread];
+                for_each_in_range(simplex_kernel, thread, no_threads, [&](const key_type& k) {
+                    if (predicate(k))
+                    {
+                        function(k, index++);
+                    }
+                });
+            });
+        }
+        
+        /**
+         * Returns whether k refers to a simplex in the mesh. Unlike exists, it accepts any key.
+         */
+        bool is_in_mesh(const NodeKey& n)
+        {
+            return n.is_valid() && static_cast<unsigned int>(n) < m_node_kernel->capacity() && exists(n);
+        }
+        
+        bool is_in_mesh(const EdgeKey& e)
+        {
+            return e.is_valid() && static_cast<unsigned int>(e) < m_edge_kernel->capacity() && exists(e);
+        }
+        
+        bool is_in_mesh(const FaceKey& f)
+        {
+            return f.is_valid() && static_cast<unsigned int>(f) < m_face_kernel->capacity() && exists(f);
+        }
+        
+        bool is_in_mesh(const TetrahedronKey& t)
+        {
+            return t.is_valid() && static_cast<unsigned int>(t) < m_tetrahedron_kernel->capacity() && exists(t);
+        }
+        
+        void check(const NodeKey& n, ValidityReport& report)
+        {
+            for (auto e : get_edges(n))
+            {
+                if (!is_in_mesh(e) || !get_nodes(e).contains(n))
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Node " + std::to_string(n) + " is not in the boundary of edge " + std::to_string(e) + ".");
                 }
             }
         }
         
-        void extract_tet_mesh(std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
+        void check(const EdgeKey& e, ValidityReport& report)
         {
-            garbage_collect();
-            
-            std::map<NodeKey, int> indices;
-            // Extract vertices
-            for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+            const SimplexSet<NodeKey>& nids = get_nodes(e);
+            if (nids.size() != 2)
             {
-                indices[nit.key()] = static_cast<int>(points.size());
-                points.push_back(nit->get_pos());
+                report.add_error(ValidityReport::CONNECTIVITY, "Edge " + std::to_string(e) + " has " + std::to_string(nids.size()) + " nodes.");
+                return;
+            }
+            for (auto n : nids)
+            {
+                if (!is_in_mesh(n) || !get_edges(n).contains(e))
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Edge " + std::to_string(e) + " is not in the co-boundary of node " + std::to_string(n) + ".");
+                    return;
+                }
             }
             
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+            int boundary = 0;
+            int interface = 0;
+            for (auto f : get_faces(e))
             {
-                for (auto n : get_nodes(tit.key()))
+                if (!is_in_mesh(f) || !get_edges(f).contains(e))
                 {
-                    tets.push_back(indices[n]);
+                    report.add_error(ValidityReport::CONNECTIVITY, "Edge " + std::to_string(e) + " is not in the boundary of face " + std::to_string(f) + ".");
+                    return;
                 }
-                tet_labels.push_back(get_label(tit.key()));
+                if (get(f).is_boundary())
+                {
+                    boundary++;
+                }
+                if (get(f).is_interface())
+                {
+                    interface++;
+                }
+            }
+            if ((get(e).is_boundary() && boundary != 2) || (!get(e).is_boundary() && boundary != 0))
+            {
+                report.add_error(ValidityReport::BOUNDARY, "Edge " + std::to_string(e) + " has " + std::to_string(boundary) + " boundary faces.");
+            }
+            if ((get(e).is_interface() && interface < 2) || (!get(e).is_interface() && interface != 0))
+            {
+                report.add_error(ValidityReport::INTERFACE, "Edge " + std::to_string(e) + " has " + std::to_string(interface) + " interface faces.");
             }
         }
-                
-        void validity_check()
+        
+        void check(const FaceKey& f, ValidityReport& report)
         {
-            std::cout << "Testing connectivity of simplicial complex: ";
-            for(auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                assert(exists(tit.key()));
-                // Check faces:
-                auto faces = get_faces(tit.key());
-                assert(faces.size() == 4);
-                for (auto f : faces) {
-                    assert(exists(f));
-                    auto cotets = get_tets(f);
-                    assert((get(f).is_boundary() && cotets.size() == 1) || (!get(f).is_boundary() && cotets.size() == 2));
-                    assert(std::find(cotets.begin(), cotets.end(), tit.key()) != cotets.end());
-                    for (auto f2 : faces) {
-                        assert(f == f2 || get_edge(f, f2).is_valid());
-                    }
-                    
-                    // Check edges:
-                    auto edges = get_edges(f);
-                    assert(edges.size() == 3);
-                    for (auto e : edges)
-                    {
-                        assert(exists(e));
-                        auto cofaces = get_faces(e);
-                        assert(std::find(cofaces.begin(), cofaces.end(), f) != cofaces.end());
-                        for (auto e2 : edges) {
-                            assert(e == e2 || get_node(e, e2).is_valid());
-                        }
-                        
-                        // Check nodes:
-                        auto nodes = get_nodes(e);
-                        assert(nodes.size() == 2);
-                        for (auto n : nodes)
-                        {
-                            assert(exists(n));
-                            auto coedges = get_edges(n);
-                            assert(std::find(coedges.begin(), coedges.end(), e) != coedges.end());
-                        }
-                    }
-                    
+            const SimplexSet<TetrahedronKey>& tids = get_tets(f);
+            if (tids.size() != 1 && tids.size() != 2)
+            {
+                report.add_error(ValidityReport::CONNECTIVITY, "Face " + std::to_string(f) + " has " + std::to_string(tids.size()) + " tetrahedra.");
+                return;
+            }
+            for (auto t : tids)
+            {
+                if (!is_in_mesh(t) || !get_faces(t).contains(f))
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Face " + std::to_string(f) + " is not in the boundary of tetrahedron " + std::to_string(t) + ".");
+                    return;
                 }
-                
-                assert(get_edges(tit.key()).size() == 6);
-                assert(get_nodes(tit.key()).size() == 4);
             }
-            std::cout << "PASSED" << std::endl;
+            if (get(f).is_boundary() != (tids.size() == 1))
+            {
+                report.add_error(ValidityReport::BOUNDARY, "Face " + std::to_string(f) + " has " + std::to_string(tids.size()) + " tetrahedra but the wrong boundary flag.");
+            }
+            bool interface = tids.size() == 1 ? get_label(tids[0]) != 0 : get_label(tids[0]) != get_label(tids[1]);
+            if (get(f).is_interface() != interface)
+            {
+                report.add_error(ValidityReport::INTERFACE, "Face " + std::to_string(f) + " has the wrong interface flag.");
+            }
             
-            std::cout << "Testing for inverted tetrahedra: ";
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+            const SimplexSet<EdgeKey>& eids = get_edges(f);
+            if (eids.size() != 3)
             {
-                assert(!is_inverted(tit.key()));
+                report.add_error(ValidityReport::CONNECTIVITY, "Face " + std::to_string(f) + " has " + std::to_string(eids.size()) + " edges.");
+                return;
+            }
+            for (auto e : eids)
+            {
+                if (!is_in_mesh(e) || !get_faces(e).contains(f))
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Face " + std::to_string(f) + " is not in the co-boundary of edge " + std::to_string(e) + ".");
+                    return;
+                }
+            }
+            for (unsigned int i = 0; i < 3; i++)
+            {
+                if (!get_node(eids[i], eids[(i+1)%3]).is_valid())
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "The edges " + std::to_string(eids[i]) + " and " + std::to_string(eids[(i+1)%3]) + " of face " + std::to_string(f) + " do not share a node.");
+                    return;
+                }
             }
-            std::cout << "PASSED" << std::endl;
             
-            std::cout << "Testing for corrupted interface or boundary: ";
-            for (auto eit = edges_begin(); eit != edges_end(); eit++)
+            // The orientation test of is_inverted, performed once for each interior face instead of once for each of its tetrahedra.
+            if (tids.size() == 2)
+            {
+                SimplexSet<NodeKey> nids = get_nodes(f);
+                NodeKey apex1 = get_apex(tids[0], f, nids);
+                NodeKey apex2 = get_apex(tids[1], f, nids);
+                if (nids.size() != 3 || !apex1.is_valid() || !apex2.is_valid())
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Face " + std::to_string(f) + " or its tetrahedra do not have the right nodes.");
+                    return;
+                }
+                double d1 = Util::orient3d(get_pos(apex1), get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]));
+                double d2 = Util::orient3d(get_pos(apex2), get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]));
+                if ((d1 < 0. && d2 < 0.) || (d1 > 0. && d2 > 0.))
+                {
+                    report.add_error(ValidityReport::INVERSION, "The tetrahedra " + std::to_string(tids[0]) + " and " + std::to_string(tids[1]) + " are on the same side of face " + std::to_string(f) + ".");
+                }
+            }
+        }
+        
+        void check(const TetrahedronKey& t, ValidityReport& report)
+        {
+            const SimplexSet<FaceKey>& fids = get_faces(t);
+            if (fids.size() != 4)
+            {
+                report.add_error(ValidityReport::CONNECTIVITY, "Tetrahedron " + std::to_string(t) + " has " + std::to_string(fids.size()) + " faces.");
+                return;
+            }
+            for (auto f : fids)
             {
-                int boundary = 0;
-                int interface = 0;
-                for (auto f : get_faces(eit.key())) {
-                    if(get(f).is_boundary())
+                if (!is_in_mesh(f) || !get_tets(f).contains(t))
+                {
+                    report.add_error(ValidityReport::CONNECTIVITY, "Tetrahedron " + std::to_string(t) + " is not in the co-boundary of face " + std::to_string(f) + ".");
+                    return;
+                }
+            }
+            
+            // The face sweep checks the edges of each face, so only the number of distinct edges and nodes is counted here.
+            std::array<unsigned int, 12> eids;
+            std::array<unsigned int, 24> nids;
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                const SimplexSet<EdgeKey>& f_eids = get_edges(fids[i]);
+                if (f_eids.size() != 3)
+                {
+                    return;
+                }
+                for (unsigned int j = 0; j < 3; j++)
+                {
+                    if (!is_in_mesh(f_eids[j]) || get_nodes(f_eids[j]).size() != 2)
                     {
-                        boundary++;
+                        return;
                     }
-                    if(get(f).is_interface())
+                    eids[3*i + j] = f_eids[j];
+                    nids[6*i + 2*j] = get_nodes(f_eids[j])[0];
+                    nids[6*i + 2*j + 1] = get_nodes(f_eids[j])[1];
+                }
+            }
+            std::sort(eids.begin(), eids.end());
+            std::sort(nids.begin(), nids.end());
+            auto no_edges = std::unique(eids.begin(), eids.end()) - eids.begin();
+            auto no_nodes = std::unique(nids.begin(), nids.end()) - nids.begin();
+            if (no_edges != 6 || no_nodes != 4)
+            {
+                report.add_error(ValidityReport::CONNECTIVITY, "Tetrahedron " + std::to_string(t) + " has " + std::to_string(no_edges) + " edges and " + std::to_string(no_nodes) + " nodes.");
+            }
+        }
+        
+        /**
+         * Returns the node of the tetrahedron t which is not a node of its face f with nodes nids, or an invalid key if there is none.
+         */
+        NodeKey get_apex(const TetrahedronKey& t, const FaceKey& f, const SimplexSet<NodeKey>& nids)
+        {
+            for (auto f2 : get_faces(t))
+            {
+                if (f2 != f)
+                {
+                    for (auto e : get_edges(f2))
                     {
-                        interface++;
+                        for (auto n : get_nodes(e))
+                        {
+                            if (!nids.contains(n))
+                            {
+                                return n;
+                            }
+                        }
                     }
                 }
-                assert((eit->is_interface() && interface >= 2) || (!eit->is_interface() && interface == 0)); // Check that the interface is not corrupted
-                assert((eit->is_boundary() && boundary == 2) || (!eit->is_boundary() && boundary == 0)); // Check that the boundary is not corrupted
             }
-            std::cout << "PASSED" << std::endl;
+            return NodeKey();
         }
     };
     
@@ -1,10 +1,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include <is_mesh/kernel_iterator.h>
+#include <is_mesh/util.h>
 
 namespace is_mesh
 {
@@ -46,6 +50,27 @@ namespace is_mesh
         };
     }
     
+    /**
+     * The memory usage of a kernel. The cells are either valid, marked for deletion or empty. The used bytes are the bytes of the valid
+     * and marked cells, and the reserved bytes are the bytes of all cells. The heap bytes are allocated by the elements themselves,
+     * for example the boundary and co-boundary sets of the simplices. The fragmentation is the fraction of the cells up to the last valid cell
+     * which are not valid. The pages which a kernel shares with its copies (see kernel::kernel(const kernel&)) are counted in the reserved
+     * and heap bytes of each of them, so the memory of a kernel and its copies is at most the sum of their reports.
+     */
+    struct kernel_memory
+    {
+        size_t size = 0;
+        size_t marked = 0;
+        size_t empty = 0;
+        size_t capacity = 0;
+        
+        size_t bytes_used = 0;
+        size_t bytes_reserved = 0;
+        size_t heap_bytes = 0;
+        
+        double fragmentation = 0.;
+    };
+    
     /**
      * Memory Kernel developed for the DSC project.
      * The kernel uses the supplied allocator to allocate memory for data structures,
@@ -53,6 +78,12 @@ namespace is_mesh
      * undo operations. Each cell in the kernel uses an excess of 12 bytes, which is used to
      * support fast iterators through the kernel and the undo functionality.
      *
+     * The cells are stored in pages of PAGE_SIZE cells, so the kernel grows without moving the
+     * cells. A copy of a kernel shares the pages with the original (copy-on-write): A page is
+     * copied the first time a cell in it is looked up for modification while it is shared, so
+     * copying a kernel costs one pointer per page and the copies only pay for the pages they
+     * modify. Read-only access (find_const, is_valid and the iterators) never copies a page.
+     *
      * @param value_type The type of the elements that is to be stored in the kernel. The value_type
      *        must have the typedef type_traits.
      * @param key_type The type of the keys used in the kernel. Should be an integer type.
@@ -77,8 +108,55 @@ namespace is_mesh
     private:
         typedef typename value_type::type_traits                        type_traits;
         
+        const static unsigned int PAGE_BITS = 8;
+        const static unsigned int PAGE_SIZE = 1u << PAGE_BITS;
+        
+        /**
+         * A page of cells. The values of the valid and marked cells are constructed, the values of the empty cells are not.
+         */
+        struct page
+        {
+            kernel_element* cells;
+            
+            page()
+            {
+                cells = allocator_type().allocate(PAGE_SIZE);
+            }
+            
+            /**
+             * Copies the cells of a shared page which is about to be modified.
+             */
+            page(const page& other) : page()
+            {
+                for (unsigned int i = 0; i < PAGE_SIZE; ++i)
+                {
+                    const kernel_element& o = other.cells[i];
+                    kernel_element& c = cells[i];
+                    c.key = o.key;
+                    c.state = o.state;
+                    c.next = o.next;
+                    c.prev = o.prev;
+                    if (o.state != kernel_element::EMPTY)
+                    {
+                        value_allocator(allocator_type()).construct(&c.value, o.value);
+                    }
+                }
+            }
+            
+            ~page()
+            {
+                allocator_type alloc;
+                for (unsigned int i = 0; i < PAGE_SIZE; ++i)
+                {
+                    if (cells[i].state == kernel_element::VALID || cells[i].state == kernel_element::MARKED)
+                        alloc.destroy(&cells[i]);
+                }
+                alloc.deallocate(cells, PAGE_SIZE);
+            }
+        };
+        
         allocator_type        m_alloc;               //the allocator
-        kernel_element*       m_mem;                 //the allocated memory
+        std::vector<std::shared_ptr<page>> m_pages;  //the allocated memory, shared with the copies of the kernel
         key_type              m_first;               //Holds the first allocated element in the collection
         key_type              m_last;                //Holds the last allocated element in the collection
         key_type              m_first_marked;        //Points to the first element (or last) that is marked for deletion
@@ -107,7 +185,26 @@ namespace is_mesh
             //asume key_type is integer type
             assert(k >= 0 || !"looked up with negative element");
             assert((int)k < m_capacity || !"k out of range");
-            return m_mem[k];
+            std::shared_ptr<page>& p = m_pages[k >> PAGE_BITS];
+            if (p.use_count() != 1)
+            {
+                p = std::make_shared<page>(*p); // copy on write
+            }
+            return p->cells[k & (PAGE_SIZE - 1)];
+        }
+        
+        /**
+         * Converts a key to the cell for reading. Unlike lookup, a shared page is not copied.
+         */
+        const kernel_element& lookup(key_type k) const
+        {
+            assert(static_cast<size_type>(k) < m_capacity || !"k out of range");
+            return m_pages[k >> PAGE_BITS]->cells[k & (PAGE_SIZE - 1)];
+        }
+        
+        const kernel_element& lookup_const(key_type k) const
+        {
+            return lookup(k);
         }
         
         /**
@@ -243,49 +340,56 @@ namespace is_mesh
         }
         
         /**
-         * Changes the size of the kernel - either grow or shrink.
-         * All allocated memory is copied.
+         * Grows the kernel to at least new_size cells, rounded up to whole pages. The new cells are appended to the empty list.
+         * The existing cells are not moved.
          *
          * @param new_size        The new size of the kernel.
          */
         void resize(size_type new_size)
         {
-            //realloc mem
-            kernel_element* new_mem = m_alloc.allocate(new_size);        //allocate new space
-            memcpy(new_mem, m_mem, m_capacity * sizeof(kernel_element));  //copy data to new mem location
-            m_alloc.deallocate(m_mem, m_capacity);                         //deallocate old mem
+            new_size = (new_size + PAGE_SIZE - 1) & ~static_cast<size_type>(PAGE_SIZE - 1);
+            assert(new_size > m_capacity);
+            while (m_pages.size() * PAGE_SIZE < new_size)
+            {
+                m_pages.push_back(std::make_shared<page>());
+            }
+            size_type old_size = m_capacity;
+            m_capacity = new_size;
+            
             //update values
-            for (unsigned int i = static_cast<unsigned int>(m_capacity); i < static_cast<unsigned int>(new_size); ++i)
+            for (unsigned int i = static_cast<unsigned int>(old_size); i < static_cast<unsigned int>(new_size); ++i)
             {
-                new_mem[i].state = kernel_element::EMPTY;
-                new_mem[i].key = i;
+                kernel_element& cur = lookup(i);
+                cur.state = kernel_element::EMPTY;
+                cur.key = i;
+                cur.prev = i == old_size ? m_last_empty : key_type(i-1);
+                cur.next = i+1 == new_size ? m_past_the_end : key_type(i+1);
             }
             
             if (m_first_empty == m_past_the_end)
             {
-                m_first_empty = static_cast<unsigned int>(m_capacity);
-                new_mem[m_capacity].prev = m_past_the_end;
+                m_first_empty = static_cast<unsigned int>(old_size);
             }
             else
             {
                 assert (m_last_empty != m_past_the_end);
-                new_mem[m_capacity].prev = m_last_empty;
-                new_mem[m_last_empty].next = static_cast<int>(m_capacity);
+                lookup(m_last_empty).next = static_cast<unsigned int>(old_size);
             }
-            
             m_last_empty = static_cast<unsigned int>(new_size) - 1;
-            new_mem[m_capacity].next   = static_cast<unsigned int>(m_capacity) + 1;
-            new_mem[m_last_empty].prev = m_last_empty-1;
-            new_mem[m_last_empty].next = m_past_the_end;
-            
-            for (unsigned int i = static_cast<unsigned int>(m_capacity) + 1; i < static_cast<unsigned int>(new_size) - 1; ++i)
+        }
+        
+        /**
+         * Writes the list pointers of a cell unless they are unchanged, such that a shared page is only copied if the cell is changed.
+         */
+        void set_links(key_type k, key_type prev, key_type next)
+        {
+            const kernel_element& cur = lookup_const(k);
+            if (cur.prev != prev || cur.next != next)
             {
-                new_mem[i].prev = i-1;
-                new_mem[i].next = i+1;
+                kernel_element& p = lookup(k);
+                p.prev = prev;
+                p.next = next;
             }
-            
-            m_capacity = new_size;
-            m_mem = new_mem;
         }
         
     public:
@@ -299,8 +403,6 @@ namespace is_mesh
         kernel(size_type size =64) : m_initial_size(size)
         { //default constructor
             assert(size > 0 || !"Cannot construct kernels with no initial memory");
-            //allocate some uninitialized memory
-            m_mem = m_alloc.allocate(m_initial_size);
             //allocate past the end
             m_past_the_end = static_cast<unsigned int>(-1);
             //initilize points
@@ -311,43 +413,27 @@ namespace is_mesh
             m_first_empty  = m_past_the_end;
             m_last_empty   = m_past_the_end;
             
-            m_capacity     = m_initial_size;
+            m_capacity     = 0;
             m_size         = 0;
             m_shadow_size  = 0;
             
-            for (unsigned int i = 0; i < m_capacity; ++i)
-            {
-                m_mem[i].state = kernel_element::EMPTY;
-                m_mem[i].key = i;
-            }
-            
-            m_first_empty = 0;
-            m_last_empty = static_cast<unsigned int>(m_capacity)-1;
-            m_mem[m_first_empty].prev = m_past_the_end;
-            m_mem[m_first_empty].next = m_first_empty+1;
-            m_mem[m_last_empty].prev  = m_last_empty-1;
-            m_mem[m_last_empty].next  = m_past_the_end;
-            
-            for (unsigned int i = 1; i < m_capacity-1; ++i)
-            {
-                m_mem[i].prev = i-1;
-                m_mem[i].next = i+1;
-            }
+            //allocate some uninitialized memory
+            resize(m_initial_size);
         }
         
         /**
-         * Kernel destructor, frees allocated memory by the kernel.
+         * Creates a copy of the kernel which shares the pages with the original until they are modified by either of them. It runs
+         * in O(n/PAGE_SIZE) where n is the capacity. Both the copy and the original must only be used by one thread at a time.
+         */
+        kernel(const kernel& other) = default;
+        
+        kernel& operator=(const kernel& other) = default;
+        
+        /**
+         * Kernel destructor, frees allocated memory by the kernel. The pages which are shared with a copy are kept by the copy.
          */
         ~kernel()
-        { //destructor
-            //call the deallocate of all managed objects
-            for(size_type i=0; i<m_capacity; ++i)
-            {
-                if (m_mem[i].state == kernel_element::VALID || m_mem[i].state == kernel_element::MARKED)
-                    m_alloc.destroy(&m_mem[i]);
-            }
-            //deallocate kernel
-            m_alloc.deallocate(m_mem, m_capacity);
+        {
         }
         
         /**
@@ -365,6 +451,41 @@ namespace is_mesh
          */
         size_type capacity() { return m_capacity; }
         
+        /**
+         * Returns the memory usage of the kernel. Runs in O(n) where n is m_capacity. If scan is false, only the counts and the bytes of the
+         * cells are returned, which runs in constant time, and the heap bytes and the fragmentation are zero.
+         */
+        kernel_memory memory(bool scan = true) const
+        {
+            kernel_memory m;
+            m.size = m_size;
+            m.marked = m_shadow_size - m_size;
+            m.empty = m_capacity - m_shadow_size;
+            m.capacity = m_capacity;
+            m.bytes_used = m_shadow_size * sizeof(kernel_element);
+            m.bytes_reserved = m_capacity * sizeof(kernel_element);
+            if (!scan)
+            {
+                return m;
+            }
+            
+            size_type end = 0;
+            for (size_type i = 0; i < m_capacity; ++i)
+            {
+                const kernel_element& cur = lookup(static_cast<unsigned int>(i));
+                if (cur.state != kernel_element::EMPTY)
+                {
+                    m.heap_bytes += cur.value.heap_bytes();
+                }
+                if (cur.state == kernel_element::VALID)
+                {
+                    end = i + 1;
+                }
+            }
+            m.fragmentation = end > 0 ? 1. - static_cast<double>(m_size) / static_cast<double>(end) : 0.;
+            return m;
+        }
+        
         /**
          * Returns a boolean value indicating if the size is zero.
          */
@@ -461,35 +582,20 @@ namespace is_mesh
          */
         void clear()
         {
-            m_alloc.deallocate(m_mem, m_capacity);
-            m_mem = m_alloc.allocate(m_capacity);
+            size_type capacity = m_capacity;
+            m_pages.clear();
             //reset pointers
             m_first        = m_past_the_end;
             m_last         = m_past_the_end;
             m_first_marked = m_past_the_end;
             m_last_marked  = m_past_the_end;
+            m_first_empty  = m_past_the_end;
+            m_last_empty   = m_past_the_end;
             
-            for (unsigned int i = 0; i < m_capacity; ++i)
-            {
-                m_mem[i].state = kernel_element::EMPTY;
-                m_mem[i].key = i;
-            }
-            
-            m_first_empty = 0;
-            m_last_empty = static_cast<unsigned int>(m_capacity)-1;
-            m_mem[m_first_empty].prev = m_past_the_end;
-            m_mem[m_first_empty].next = m_first_empty+1;
-            m_mem[m_last_empty].prev  = m_last_empty-1;
-            m_mem[m_last_empty].next  = m_past_the_end;
-            
-            for (unsigned int i = 1; i < m_capacity-1; ++i)
-            {
-                m_mem[i].prev = i-1;
-                m_mem[i].next = i+1;
-            }
-            
+            m_capacity     = 0;
             m_size         = 0;
             m_shadow_size  = 0;
+            resize(capacity);
         }
         
         /**
@@ -500,7 +606,7 @@ namespace is_mesh
         iterator find_iterator(key_type const & k)
         {
             //we dont just return iterator(this, k) as this is not defensive enough, we need to return valid values.
-            kernel_element& tmp = lookup(k);
+            const kernel_element& tmp = lookup_const(k);
             if (tmp.state == kernel_element::VALID && tmp.key == k)
                 return iterator(this, k);
             else
@@ -508,7 +614,8 @@ namespace is_mesh
         }
         
         /**
-         * Returns a managed object. Beware of deallocating or other memory
+         * Returns a managed object for modification. If the page of the object is shared with a copy of
+         * the kernel, the page is copied first. Beware of deallocating or other memory
          * handlings of the returned object, as this might lead to undefined
          * behavior in the kernel.
          *
@@ -527,9 +634,12 @@ namespace is_mesh
          *
          * @param k     The handle to the object.
          */
-        value_type const & find_const(key_type const & k)
+        value_type const & find_const(key_type const & k) const
         {
-            return find(k);
+            const kernel_element& tmp = lookup_const(k);
+            assert(tmp.state == kernel_element::VALID);
+            assert(tmp.key == k);
+            return tmp.value;
         }
         
         /**
@@ -538,9 +648,9 @@ namespace is_mesh
          * @param k     The handle to the object.
          * @returns     True if the object is a valid element, false if it is marked for deletion or k refers to an empty cell.
          */
-        bool is_valid(key_type const & k)
+        bool is_valid(key_type const & k) const
         {
-            kernel_element& tmp = lookup(k);
+            const kernel_element& tmp = lookup_const(k);
             if (tmp.state == kernel_element::VALID) return true;
             return false;
         }
@@ -553,7 +663,7 @@ namespace is_mesh
             key_type m = m_first_marked;
             while (m != m_past_the_end)
             {
-                kernel_element* p = &m_mem[m_first_marked];
+                kernel_element* p = &lookup(m_first_marked);
                 key_type n = p->next;
                 
                 unlink(*p, m_first_marked, m_last_marked);
@@ -575,35 +685,64 @@ namespace is_mesh
          */
         void reorder_lists()
         {
-            //first reset list pointers
-            m_first        = m_past_the_end;
-            m_last         = m_past_the_end;
-            m_first_marked = m_past_the_end;
-            m_last_marked  = m_past_the_end;
-            m_first_empty  = m_past_the_end;
-            m_last_empty   = m_past_the_end;
-            
-            //now rebuild lists in incremental order of key
-            for(size_type i = 0; i < m_capacity; ++i) 
+            //rebuild lists in incremental order of key. Only the cells whose list pointers change are written, so the pages
+            //which are shared with a copy of the kernel and are already in order are not copied.
+            key_type first = m_past_the_end, last = m_past_the_end, last_prev = m_past_the_end;
+            key_type first_empty = m_past_the_end, last_empty = m_past_the_end, last_empty_prev = m_past_the_end;
+            for(size_type i = 0; i < m_capacity; ++i)
             {
-                kernel_element & p = lookup(static_cast<int>(i));
-                p.next = m_past_the_end; //always set this just to be sure to end the lists - likely to be overwritten
-                if ( p.state == kernel_element::VALID) 
+                key_type k = static_cast<unsigned int>(i);
+                const kernel_element & p = lookup_const(k);
+                if ( p.state == kernel_element::VALID)
+                {
+                    if (last == m_past_the_end)
+                    {
+                        first = k;
+                    }
+                    else
+                    {
+                        set_links(last, last_prev, k);
+                    }
+                    last_prev = last;
+                    last = k;
+                }
+                else
                 {
-                    link_at_end(p, m_first, m_last);
-                } 
-                else 
-                { 
                     if ( p.state == kernel_element::MARKED )
                     {
                         std::cout << "something's wrong" << std::endl;
                         //should've been handled by commit
-                        m_alloc.destroy(&p);
+                        kernel_element & q = lookup(k);
+                        m_alloc.destroy(&q);
+                        q.state = kernel_element::EMPTY;
+                    }
+                    if (last_empty == m_past_the_end)
+                    {
+                        first_empty = k;
+                    }
+                    else
+                    {
+                        set_links(last_empty, last_empty_prev, k);
                     }
-                    p.state = kernel_element::EMPTY;
-                    link_at_end(p, m_first_empty, m_last_empty);
+                    last_empty_prev = last_empty;
+                    last_empty = k;
                 }
             }
+            if (last != m_past_the_end)
+            {
+                set_links(last, last_prev, m_past_the_end);
+            }
+            if (last_empty != m_past_the_end)
+            {
+                set_links(last_empty, last_empty_prev, m_past_the_end);
+            }
+            
+            m_first        = first;
+            m_last         = last;
+            m_first_marked = m_past_the_end;
+            m_last_marked  = m_past_the_end;
+            m_first_empty  = first_empty;
+            m_last_empty   = last_empty;
             m_shadow_size = m_size;
         }
         
@@ -620,6 +759,140 @@ namespace is_mesh
             commit_all();
             reorder_lists();
         }
+        
+        /**
+         * Writes the kernel to a binary stream in its native layout, that is the state and list pointers of every cell including the marked
+         * and empty cells, followed by the attributes and the boundary and co-boundary sets of the valid and marked elements. Thereby, load
+         * restores the kernel with the same keys and free lists. The attributes (the type_traits of the elements) are written as raw bytes
+         * and must therefore be trivially copyable.
+         */
+        void save(std::ostream& os) const
+        {
+            struct cell { key_type key, next, prev; typename kernel_element::state_type state; };
+            std::vector<cell> cells(m_capacity);
+            std::vector<char> attributes;
+            std::vector<unsigned int> sets;
+            attributes.reserve(m_shadow_size * sizeof(type_traits));
+            sets.reserve(m_shadow_size * 8);
+            for (size_type i = 0; i < m_capacity; ++i)
+            {
+                const kernel_element& p = lookup_const(static_cast<unsigned int>(i));
+                cells[i] = {p.key, p.next, p.prev, p.state};
+                if (p.state != kernel_element::EMPTY)
+                {
+                    const char* bytes = reinterpret_cast<const char*>(static_cast<const type_traits*>(&p.value));
+                    attributes.insert(attributes.end(), bytes, bytes + sizeof(type_traits));
+                    p.value.save(sets);
+                }
+            }
+            
+            unsigned int sizes[] = {sizeof(kernel_element), sizeof(type_traits)};
+            Util::write_binary(os, sizes);
+            unsigned long long counts[] = {m_size, m_shadow_size, m_capacity, m_initial_size};
+            Util::write_binary(os, counts);
+            key_type lists[] = {m_first, m_last, m_first_marked, m_last_marked, m_first_empty, m_last_empty};
+            Util::write_binary(os, lists);
+            Util::write_binary(os, cells);
+            Util::write_binary(os, attributes);
+            Util::write_binary(os, sets);
+        }
+        
+        /**
+         * Replaces the content of the kernel by a kernel written by save. Returns false and leaves the kernel unchanged if the stream fails
+         * or was written with other element types.
+         */
+        bool load(std::istream& is)
+        {
+            struct cell { key_type key, next, prev; typename kernel_element::state_type state; };
+            unsigned int sizes[2];
+            unsigned long long counts[4];
+            key_type lists[6];
+            std::vector<cell> cells;
+            std::vector<char> attributes;
+            std::vector<unsigned int> sets;
+            Util::read_binary(is, sizes);
+            if (!is || sizes[0] != sizeof(kernel_element) || sizes[1] != sizeof(type_traits))
+            {
+                return false;
+            }
+            Util::read_binary(is, counts);
+            Util::read_binary(is, lists);
+            Util::read_binary(is, cells);
+            Util::read_binary(is, attributes);
+            Util::read_binary(is, sets);
+            if (!is || cells.size() != counts[2] || attributes.size() != counts[1] * sizeof(type_traits) || counts[2] == 0)
+            {
+                return false;
+            }
+            size_t no_elements = 0;
+            for (const cell& c : cells)
+            {
+                if (c.state != kernel_element::EMPTY)
+                {
+                    no_elements++;
+                }
+            }
+            if (no_elements != counts[1])
+            {
+                return false;
+            }
+            size_t pos = 0;
+            for (size_t j = 0; j < 2*no_elements; ++j)
+            {
+                if (pos >= sets.size())
+                {
+                    return false;
+                }
+                pos += 1 + sets[pos];
+            }
+            if (pos != sets.size())
+            {
+                return false;
+            }
+            
+            m_pages.clear();
+            m_size = counts[0];
+            m_shadow_size = counts[1];
+            m_capacity = counts[2];
+            m_initial_size = counts[3];
+            m_first = lists[0];
+            m_last = lists[1];
+            m_first_marked = lists[2];
+            m_last_marked = lists[3];
+            m_first_empty = lists[4];
+            m_last_empty = lists[5];
+            
+            m_pages.resize((m_capacity + PAGE_SIZE - 1) >> PAGE_BITS);
+            for (auto& p : m_pages)
+            {
+                p = std::make_shared<page>();
+                for (unsigned int i = 0; i < PAGE_SIZE; ++i)
+                {
+                    p->cells[i].state = kernel_element::EMPTY;
+                }
+            }
+            const unsigned int* data = sets.data();
+            size_t j = 0;
+            for (size_type i = 0; i < m_capacity; ++i)
+            {
+                kernel_element& p = lookup(static_cast<unsigned int>(i));
+                p.key = cells[i].key;
+                p.next = cells[i].next;
+                p.prev = cells[i].prev;
+                p.state = cells[i].state;
+                if (p.state != kernel_element::EMPTY)
+                {
+                    value_allocator(m_alloc).construct(&p.value, value_type(*reinterpret_cast<const type_traits*>(&attributes[j])));
+                    j += sizeof(type_traits);
+                    p.value.load(data);
+                }
+            }
+            if (m_capacity % PAGE_SIZE != 0)
+            {
+                resize(m_capacity); // Fills the last page with empty cells.
+            }
+            return true;
+        }
     };
     
 }
@@ -34,7 +34,7 @@ namespace is_mesh
         
         key_type         m_key;
         kernel_type*     m_kernel;
-        value_type*      m_value;   //temporary storage for value when returning it
+        const value_type* m_value;  //temporary storage for value when returning it
         
     public:
         /**
@@ -74,26 +74,26 @@ namespace is_mesh
         }
         
         /**
-         * The member access operator.
+         * The member access operator. The element is read-only, since it may be shared with a copy of the kernel (see kernel::find).
          *
          * @return Pointer to the element contained within the kernel cell.
          */
-        value_type* operator->()
+        const value_type* operator->()
         {
-            assert(m_kernel->lookup(m_key).state == element_type::VALID);
-            m_value = &m_kernel->lookup(m_key).value;
+            assert(m_kernel->lookup_const(m_key).state == element_type::VALID);
+            m_value = &m_kernel->lookup_const(m_key).value;
             return m_value;
         }
         
         /**
-         * The dereference operator.
+         * The dereference operator. The element is read-only (see operator->).
          *
          * @return The element that is contained within the kernel cell.
          */
-        value_type& operator*()
+        const value_type& operator*()
         {
-            assert(m_kernel->lookup(m_key).state == element_type::VALID);
-            m_value = &m_kernel->lookup(m_key).value;
+            assert(m_kernel->lookup_const(m_key).state == element_type::VALID);
+            m_value = &m_kernel->lookup_const(m_key).value;
             return *m_value;
         }
         
@@ -104,7 +104,7 @@ namespace is_mesh
          */
         iterator& operator++()
         {
-            kernel_element& cur = m_kernel->lookup(m_key);
+            const kernel_element& cur = m_kernel->lookup_const(m_key);
             m_key = cur.next;
             return *this;
         }
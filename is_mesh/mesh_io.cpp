@@ -15,10 +15,128 @@
 //  See licence.txt for a copy of the GNU General Public License.
 
 #include "mesh_io.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <thread>
 
 namespace is_mesh {
     
+    static_assert(sizeof(vec3) == 3*sizeof(real), "The points are written as one array of reals.");
+    
+    bool is_little_endian()
+    {
+        const unsigned int one = 1;
+        return *reinterpret_cast<const unsigned char*>(&one) == 1;
+    }
+    
+    /**
+     * A binary output file with a large buffer. The arrays of the binary formats are written with one call each.
+     */
+    class BinaryFile
+    {
+        std::vector<char> buffer = std::vector<char>(1 << 20);
+        std::ofstream file;
+        
+    public:
+        BinaryFile(const std::string& filename)
+        {
+            file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            file.open(filename.data(), std::ios::binary);
+        }
+        
+        std::ofstream& get()
+        {
+            return file;
+        }
+        
+        void write(const void* data, size_t bytes)
+        {
+            file.write(static_cast<const char*>(data), bytes);
+        }
+    };
+    
+    /**
+     * An array of the appended data of a .vtu file. A raw array is written as its number of bytes followed by the data, which is not copied.
+     * A compressed array is split into blocks which are compressed by the zlib compressor in parallel, and it is written as the number of blocks, the block
+     * size, the size of the last block and the compressed size of each block followed by the compressed blocks.
+     */
+    class VTUArray
+    {
+        const static unsigned long long BLOCK_SIZE = 1 << 20;
+        
+        std::vector<unsigned long long> header;
+        const void* data;
+        std::vector<std::vector<unsigned char>> blocks;
+        
+    public:
+        VTUArray(const void* data_, size_t bytes, const zlib_compressor& compress) : data(data_)
+        {
+            if (!compress)
+            {
+                header = {bytes};
+                return;
+            }
+            
+            unsigned long long no_blocks = (bytes + BLOCK_SIZE - 1)/BLOCK_SIZE;
+            header = {no_blocks, BLOCK_SIZE, no_blocks == 0 ? 0 : bytes - (no_blocks - 1)*BLOCK_SIZE};
+            header.resize(3 + no_blocks);
+            blocks.resize(no_blocks);
+            
+            unsigned int no_threads = std::max(1u, std::min(static_cast<unsigned int>(no_blocks), std::thread::hardware_concurrency()));
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < no_threads; t++)
+            {
+                threads.push_back(std::thread([this, &compress, t, no_threads, no_blocks]() {
+                    for (unsigned long long b = t; b < no_blocks; b += no_threads)
+                    {
+                        const unsigned char* block = static_cast<const unsigned char*>(data) + b*BLOCK_SIZE;
+                        blocks[b] = compress(block, b + 1 < no_blocks ? BLOCK_SIZE : header[2]);
+                        header[3 + b] = blocks[b].size();
+                    }
+                }));
+            }
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+        
+        VTUArray(const VTUArray&) = delete;
+        VTUArray& operator=(const VTUArray&) = delete;
+        
+        /**
+         * Returns the number of bytes written by write.
+         */
+        unsigned long long get_size() const
+        {
+            unsigned long long size = header.size()*sizeof(unsigned long long);
+            if (blocks.empty())
+            {
+                return size + header[0];
+            }
+            for (unsigned int b = 0; b < blocks.size(); b++)
+            {
+                size += header[3 + b];
+            }
+            return size;
+        }
+        
+        void write(BinaryFile& file) const
+        {
+            file.write(header.data(), header.size()*sizeof(unsigned long long));
+            if (blocks.empty())
+            {
+                file.write(data, header[0]);
+            }
+            for (unsigned int b = 0; b < blocks.size(); b++)
+            {
+                file.write(blocks[b].data(), blocks[b].size());
+            }
+        }
+    };
+    
     void scale(std::vector<vec3>& points, real size)
     {
         vec3 p_min(INFINITY), p_max(-INFINITY);
@@ -44,10 +162,9 @@ namespace is_mesh {
     {
         std::ifstream file(filename.data());
         
-        while (!file.eof())
+        char c;
+        while (file >> c) // Stops when nothing more is read, otherwise the last tetrahedron would be read twice.
         {
-            char c;
-            file >> c;
             if (c == 'v')
             {
                 real x,y,z; // The (x,y,z) coordinates of a vertex.
@@ -73,7 +190,6 @@ namespace is_mesh {
                 
                 tet_labels.push_back(label);
             }
-            c = '\n';
         }
         file.close();
         scale(points, 3.);
@@ -125,26 +241,28 @@ namespace is_mesh {
         scale(points, 2.);
     }
     
-    void export_tet_mesh(const std::string& filename, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
+    void export_tet_mesh(const std::string& filename, const std::vector<vec3>& mesh_points, const std::vector<int>& tets, const std::vector<int>& tet_labels)
     {
+        std::vector<vec3> points = mesh_points;
         scale(points, 3.);
         std::ofstream file(filename.data());
         
         for (auto &p : points)
         {
-            file << "v " << p[0] << " " << p[1] << " " << p[2] << std::endl;
+            file << "v " << p[0] << " " << p[1] << " " << p[2] << "\n";
         }
         
         for (unsigned int i = 0; i < tet_labels.size(); i++)
         {
             file << "t ";
             file << tets[4*i] << " " << tets[4*i+1] << " " << tets[4*i+2] << " " << tets[4*i+3] << " ";
-            file << tet_labels[i] << std::endl;
+            file << tet_labels[i] << "\n";
         }
     }
     
-    void export_surface_mesh(const std::string& filename, std::vector<vec3>& points, std::vector<int>& faces)
+    void export_surface_mesh(const std::string& filename, const std::vector<vec3>& mesh_points, const std::vector<int>& faces)
     {
+        std::vector<vec3> points = mesh_points;
         scale(points, 2.);
         std::ofstream obj_file;
         obj_file.open(filename.data());
@@ -160,7 +278,7 @@ namespace is_mesh {
             {
                 obj_file << "f ";
             }
-            obj_file << faces[i];
+            obj_file << faces[i] + 1; // The indices of .obj files start at one.
             if (i%3 == 2)
             {
                 obj_file << std::endl;
@@ -172,4 +290,78 @@ namespace is_mesh {
         
         obj_file.close();
     }
+    
+    void export_tet_mesh_vtu(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels, const zlib_compressor& compress)
+    {
+        size_t no_tets = tet_labels.size();
+        std::vector<int> offsets(no_tets);
+        for (size_t i = 0; i < no_tets; i++)
+        {
+            offsets[i] = static_cast<int>(4*(i + 1));
+        }
+        std::vector<unsigned char> types(no_tets, 10); // VTK_TETRA
+        
+        std::vector<std::unique_ptr<VTUArray>> arrays;
+        arrays.push_back(std::unique_ptr<VTUArray>(new VTUArray(points.data(), points.size()*sizeof(vec3), compress)));
+        arrays.push_back(std::unique_ptr<VTUArray>(new VTUArray(tets.data(), tets.size()*sizeof(int), compress)));
+        arrays.push_back(std::unique_ptr<VTUArray>(new VTUArray(offsets.data(), offsets.size()*sizeof(int), compress)));
+        arrays.push_back(std::unique_ptr<VTUArray>(new VTUArray(types.data(), types.size(), compress)));
+        arrays.push_back(std::unique_ptr<VTUArray>(new VTUArray(tet_labels.data(), tet_labels.size()*sizeof(int), compress)));
+        std::vector<unsigned long long> array_offsets(arrays.size(), 0);
+        for (unsigned int i = 1; i < arrays.size(); i++)
+        {
+            array_offsets[i] = array_offsets[i-1] + arrays[i-1]->get_size();
+        }
+        
+        BinaryFile file(filename);
+        std::ofstream& xml = file.get();
+        xml << "<?xml version=\"1.0\"?>\n";
+        xml << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"" << (is_little_endian() ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\"";
+        if (compress)
+        {
+            xml << " compressor=\"vtkZLibDataCompressor\"";
+        }
+        xml << ">\n<UnstructuredGrid>\n";
+        xml << "<Piece NumberOfPoints=\"" << points.size() << "\" NumberOfCells=\"" << no_tets << "\">\n";
+        xml << "<Points>\n";
+        xml << "<DataArray type=\"" << (sizeof(real) == sizeof(double) ? "Float64" : "Float32") << "\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" << array_offsets[0] << "\"/>\n";
+        xml << "</Points>\n<Cells>\n";
+        xml << "<DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"" << array_offsets[1] << "\"/>\n";
+        xml << "<DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"" << array_offsets[2] << "\"/>\n";
+        xml << "<DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"" << array_offsets[3] << "\"/>\n";
+        xml << "</Cells>\n<CellData Scalars=\"label\">\n";
+        xml << "<DataArray type=\"Int32\" Name=\"label\" format=\"appended\" offset=\"" << array_offsets[4] << "\"/>\n";
+        xml << "</CellData>\n</Piece>\n</UnstructuredGrid>\n";
+        xml << "<AppendedData encoding=\"raw\">\n_";
+        for (auto& array : arrays)
+        {
+            array->write(file);
+        }
+        xml << "\n</AppendedData>\n</VTKFile>\n";
+    }
+    
+    void export_surface_mesh_ply(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& faces)
+    {
+        // Each face is written as the number of nodes followed by the three indices.
+        size_t no_faces = faces.size()/3;
+        const size_t face_size = 1 + 3*sizeof(int);
+        std::vector<char> face_data(no_faces*face_size);
+        for (size_t i = 0; i < no_faces; i++)
+        {
+            face_data[i*face_size] = 3;
+            memcpy(&face_data[i*face_size + 1], &faces[3*i], 3*sizeof(int));
+        }
+        
+        BinaryFile file(filename);
+        const char* real_type = sizeof(real) == sizeof(double) ? "double" : "float";
+        file.get() << "ply\n";
+        file.get() << "format " << (is_little_endian() ? "binary_little_endian" : "binary_big_endian") << " 1.0\n";
+        file.get() << "element vertex " << points.size() << "\n";
+        file.get() << "property " << real_type << " x\nproperty " << real_type << " y\nproperty " << real_type << " z\n";
+        file.get() << "element face " << no_faces << "\n";
+        file.get() << "property list uchar int vertex_indices\n";
+        file.get() << "end_header\n";
+        file.write(points.data(), points.size()*sizeof(vec3));
+        file.write(face_data.data(), face_data.size());
+    }
 }
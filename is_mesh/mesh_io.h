@@ -17,6 +17,7 @@
 #pragma once
 
 #include "util.h"
+#include <functional>
 
 namespace is_mesh {
     
@@ -31,12 +32,28 @@ namespace is_mesh {
     void import_surface_mesh(const std::string& filename, std::vector<vec3>& points, std::vector<int>& faces);
     
     /**
-     * Exports the mesh as a .dsc file.
+     * Exports the mesh as a .dsc file. The points are scaled to the size used by import_tet_mesh.
      */
-    void export_tet_mesh(const std::string& filename, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels);
+    void export_tet_mesh(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels);
     
     /**
-     * Exports the surface mesh to an .obj file.
+     * Exports the surface mesh, which has zero-based indices, to an .obj file. The points are scaled to the size used by import_surface_mesh.
      */
-    void export_surface_mesh(const std::string& filename, std::vector<vec3>& points, std::vector<int>& faces);
+    void export_surface_mesh(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& faces);
+    
+    /**
+     * Compresses a block of bytes to a zlib stream, for example with compress of zlib. It is called from several threads at once.
+     */
+    typedef std::function<std::vector<unsigned char>(const unsigned char* data, size_t bytes)> zlib_compressor;
+    
+    /**
+     * Exports the mesh to a VTK unstructured grid (.vtu) file with the points, the tetrahedra and a label array per tetrahedron, for example for
+     * ParaView. The arrays are appended in binary, compressed with the given zlib compressor unless it is empty, and the points are not scaled.
+     */
+    void export_tet_mesh_vtu(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& tets, const std::vector<int>& tet_labels, const zlib_compressor& compress = nullptr);
+    
+    /**
+     * Exports the surface mesh, for example the interface, to a binary .ply file. The points are not scaled.
+     */
+    void export_surface_mesh_ply(const std::string& filename, const std::vector<vec3>& points, const std::vector<int>& faces);
 }
@@ -32,6 +32,15 @@ namespace is_mesh
         SimplexSet<boundary_key_type>* m_boundary = nullptr;
         SimplexSet<co_boundary_key_type>* m_co_boundary = nullptr;
         
+        /**
+         * Creates a key of the given type from an integer, also for the base class Key whose constructor is protected.
+         */
+        template<typename key_type>
+        struct key_from : public key_type
+        {
+            key_from(unsigned int k) : key_type(k) {}
+        };
+        
     public:
         
         Simplex()
@@ -77,6 +86,57 @@ namespace is_mesh
             return *m_boundary;
         }
         
+        /**
+         * Returns the number of bytes allocated on the heap for the boundary and co-boundary sets, not counting the overhead of the allocator.
+         */
+        size_t heap_bytes() const
+        {
+            size_t bytes = 0;
+            if(m_boundary)
+            {
+                bytes += sizeof(SimplexSet<boundary_key_type>) + m_boundary->capacity()*sizeof(boundary_key_type);
+            }
+            if(m_co_boundary)
+            {
+                bytes += sizeof(SimplexSet<co_boundary_key_type>) + m_co_boundary->capacity()*sizeof(co_boundary_key_type);
+            }
+            return bytes;
+        }
+        
+        /**
+         * Appends the sizes and the keys of the boundary and co-boundary sets to data in their order.
+         */
+        void save(std::vector<unsigned int>& data) const
+        {
+            data.push_back(m_boundary->size());
+            for (const boundary_key_type& k : *m_boundary)
+            {
+                data.push_back(k);
+            }
+            data.push_back(m_co_boundary->size());
+            for (const co_boundary_key_type& k : *m_co_boundary)
+            {
+                data.push_back(k);
+            }
+        }
+        
+        /**
+         * Reads the boundary and co-boundary sets written by save from data and advances data past them.
+         */
+        void load(const unsigned int*& data)
+        {
+            unsigned int size = *data++;
+            for (unsigned int i = 0; i < size; i++)
+            {
+                m_boundary->push_back(key_from<boundary_key_type>(*data++));
+            }
+            size = *data++;
+            for (unsigned int i = 0; i < size; i++)
+            {
+                m_co_boundary->push_back(key_from<co_boundary_key_type>(*data++));
+            }
+        }
+        
         void add_co_face(const co_boundary_key_type& key)
         {
             *m_co_boundary += key;
@@ -81,6 +81,14 @@ namespace is_mesh
             return static_cast<unsigned int>(set.size());
         }
         
+        /**
+         * Returns the number of keys the set has allocated memory for.
+         */
+        unsigned int capacity() const
+        {
+            return static_cast<unsigned int>(set.capacity());
+        }
+        
         const key_type& front() const
         {
             assert(set.size() > 0);
@@ -0,0 +1,541 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include "util.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace is_mesh
+{
+    /**
+     The format of a time series file. It starts with a header, which is the magic string, the type of the positions (0 for quantized positions
+     stored as 32 bit integers, 4 for floats or 8 for doubles) and the quantum as a double. Then follow the frames, each stored as its number of
+     bytes and the data. A frame is the time step, whether it is a keyframe, the removed nodes, the added or moved nodes with their positions,
+     the removed tetrahedra and the added or changed tetrahedra with their nodes and labels. The simplices are identified by their keys. A
+     keyframe contains the whole mesh and no removals. When the file is closed, an index of the frames is written at the end, starting and
+     ending with the index tag and followed by its offset, so that the reader can seek to a keyframe. The numbers are written in the byte order of the machine.
+     */
+    namespace time_series
+    {
+        const char MAGIC[8] = {'D', 'S', 'C', 'S', 'E', 'R', 'I', 'E'};
+        const char INDEX_TAG[8] = {'D', 'S', 'C', 'I', 'N', 'D', 'E', 'X'};
+        
+        struct FrameInfo
+        {
+            int time_step;
+            bool keyframe;
+            unsigned long long offset; // The position of the frame in the file.
+        };
+        
+        /**
+         The state of the mesh which a frame was encoded from or is decoded into. All vectors are indexed by the keys of the simplices.
+         */
+        struct State
+        {
+            std::vector<char> node_exists;
+            std::vector<std::array<real, 3>> positions; // Quantized if the quantum is positive.
+            
+            std::vector<char> tet_exists;
+            std::vector<std::array<unsigned int, 4>> tet_nodes;
+            std::vector<int> tet_labels;
+            
+            void clear()
+            {
+                node_exists.clear();
+                tet_exists.clear();
+            }
+            
+            void add_node(unsigned int k, const std::array<real, 3>& p)
+            {
+                if (k >= node_exists.size())
+                {
+                    node_exists.resize(k + 1, false);
+                    positions.resize(k + 1);
+                }
+                node_exists[k] = true;
+                positions[k] = p;
+            }
+            
+            void add_tet(unsigned int k, const std::array<unsigned int, 4>& nodes, int label)
+            {
+                if (k >= tet_exists.size())
+                {
+                    tet_exists.resize(k + 1, false);
+                    tet_nodes.resize(k + 1);
+                    tet_labels.resize(k + 1);
+                }
+                tet_exists[k] = true;
+                tet_nodes[k] = nodes;
+                tet_labels[k] = label;
+            }
+        };
+        
+        template<typename T>
+        void append(std::vector<char>& data, const T& value)
+        {
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            data.insert(data.end(), bytes, bytes + sizeof(T));
+        }
+        
+        template<typename T>
+        T read_value(const char*& data)
+        {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            data += sizeof(T);
+            return value;
+        }
+    }
+    
+    /**
+     Writes the evolution of a mesh to a time series file (see time_series) which is much smaller than a mesh per time step, since only the
+     nodes which moved and the tetrahedra which were changed by the operations of the DSC method (splits, collapses, flips and relabelling) are
+     stored between the keyframes. The changes are found by comparing the mesh with the state which was encoded last, key by key. If the
+     quantum is positive, the positions are rounded to multiples of it and stored as integers, and nodes which moved less are not stored.
+     Encoding and writing are separate, so that a frame can be encoded on the simulation thread and written on another thread.
+     */
+    class TimeSeriesWriter
+    {
+    public:
+        struct Frame
+        {
+            int time_step;
+            bool keyframe;
+            std::vector<char> data;
+        };
+    
+    private:
+        std::ofstream file;
+        int keyframe_interval;
+        double quantum;
+        
+        // Used by encode.
+        int no_encoded = 0;
+        time_series::State state;
+        
+        // Used by write.
+        std::vector<time_series::FrameInfo> index;
+    
+    public:
+        /**
+         Creates the file. A keyframe is written every keyframe_interval frames.
+         */
+        TimeSeriesWriter(const std::string& filename, int keyframe_interval_ = 25, double quantum_ = 0.) : file(filename.data(), std::ios::binary),
+            keyframe_interval(std::max(keyframe_interval_, 1)), quantum(quantum_)
+        {
+            file.write(time_series::MAGIC, sizeof(time_series::MAGIC));
+            int type = quantum > 0. ? 0 : static_cast<int>(sizeof(real));
+            file.write(reinterpret_cast<const char*>(&type), sizeof(type));
+            file.write(reinterpret_cast<const char*>(&quantum), sizeof(quantum));
+        }
+        
+        /**
+         Writes the index and closes the file.
+         */
+        ~TimeSeriesWriter()
+        {
+            unsigned long long index_offset = static_cast<unsigned long long>(file.tellp());
+            unsigned int no_frames = static_cast<unsigned int>(index.size());
+            file.write(time_series::INDEX_TAG, sizeof(time_series::INDEX_TAG));
+            file.write(reinterpret_cast<const char*>(&no_frames), sizeof(no_frames));
+            for (auto& info : index)
+            {
+                char keyframe = info.keyframe;
+                file.write(reinterpret_cast<const char*>(&info.time_step), sizeof(info.time_step));
+                file.write(&keyframe, sizeof(keyframe));
+                file.write(reinterpret_cast<const char*>(&info.offset), sizeof(info.offset));
+            }
+            file.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+            file.write(time_series::INDEX_TAG, sizeof(time_series::INDEX_TAG));
+        }
+        
+        /**
+         Returns the frame which changes the previously encoded mesh into the given mesh.
+         */
+        template<typename mesh_type>
+        Frame encode(mesh_type& mesh, int time_step)
+        {
+            using namespace time_series;
+            Frame frame;
+            frame.time_step = time_step;
+            frame.keyframe = no_encoded % keyframe_interval == 0;
+            no_encoded++;
+            
+            State old_state;
+            std::swap(old_state, state);
+            if (frame.keyframe)
+            {
+                old_state.clear();
+            }
+            
+            // Nodes
+            std::vector<char> changed;
+            unsigned int no_changed = 0;
+            for (auto nit = mesh.nodes_begin(); nit != mesh.nodes_end(); nit++)
+            {
+                unsigned int k = nit.key();
+                vec3 p = nit->get_pos();
+                std::array<real, 3> value = {{p[0], p[1], p[2]}};
+                if (quantum > 0.)
+                {
+                    for (auto& v : value)
+                    {
+                        v = static_cast<real>(std::floor(v/quantum + 0.5));
+                    }
+                }
+                state.add_node(k, value);
+                if (k >= old_state.node_exists.size() || !old_state.node_exists[k] || old_state.positions[k] != value)
+                {
+                    append(changed, k);
+                    for (auto v : value)
+                    {
+                        if (quantum > 0.)
+                        {
+                            append(changed, static_cast<int>(v));
+                        }
+                        else {
+                            append(changed, v);
+                        }
+                    }
+                    no_changed++;
+                }
+            }
+            append(frame.data, time_step);
+            append(frame.data, static_cast<char>(frame.keyframe));
+            append_removed(frame.data, old_state.node_exists, state.node_exists);
+            append(frame.data, no_changed);
+            frame.data.insert(frame.data.end(), changed.begin(), changed.end());
+            
+            // Tetrahedra
+            changed.clear();
+            no_changed = 0;
+            for (auto tit = mesh.tetrahedra_begin(); tit != mesh.tetrahedra_end(); tit++)
+            {
+                unsigned int k = tit.key();
+                auto nids = mesh.get_nodes(tit.key());
+                std::array<unsigned int, 4> nodes = {{nids[0], nids[1], nids[2], nids[3]}};
+                int label = mesh.get_label(tit.key());
+                state.add_tet(k, nodes, label);
+                if (k >= old_state.tet_exists.size() || !old_state.tet_exists[k] || old_state.tet_nodes[k] != nodes || old_state.tet_labels[k] != label)
+                {
+                    append(changed, k);
+                    for (auto n : nodes)
+                    {
+                        append(changed, n);
+                    }
+                    append(changed, label);
+                    no_changed++;
+                }
+            }
+            append_removed(frame.data, old_state.tet_exists, state.tet_exists);
+            append(frame.data, no_changed);
+            frame.data.insert(frame.data.end(), changed.begin(), changed.end());
+            return frame;
+        }
+        
+        /**
+         Writes a frame returned by encode. The frames must be written in the order they were encoded.
+         */
+        void write(const Frame& frame)
+        {
+            index.push_back({frame.time_step, frame.keyframe, static_cast<unsigned long long>(file.tellp())});
+            unsigned int size = static_cast<unsigned int>(frame.data.size());
+            file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            file.write(frame.data.data(), frame.data.size());
+        }
+        
+        template<typename mesh_type>
+        void write(mesh_type& mesh, int time_step)
+        {
+            write(encode(mesh, time_step));
+        }
+    
+    private:
+        /**
+         Appends the number and keys of the simplices which exist in the old state but not in the new.
+         */
+        static void append_removed(std::vector<char>& data, const std::vector<char>& old_exists, const std::vector<char>& new_exists)
+        {
+            std::vector<unsigned int> removed;
+            for (unsigned int k = 0; k < old_exists.size(); k++)
+            {
+                if (old_exists[k] && (k >= new_exists.size() || !new_exists[k]))
+                {
+                    removed.push_back(k);
+                }
+            }
+            time_series::append(data, static_cast<unsigned int>(removed.size()));
+            for (auto k : removed)
+            {
+                time_series::append(data, k);
+            }
+        }
+    };
+    
+    /**
+     Reads a time series file written by TimeSeriesWriter. A time step is found by seeking to the last keyframe before it and applying the
+     following frames, or by continuing from the previously read time step if it is closer. If the file was not closed, for example because the
+     simulation crashed, the frames are found by scanning the file.
+     */
+    class TimeSeriesReader
+    {
+        std::ifstream file;
+        int type = 0;
+        double quantum = 0.;
+        std::vector<time_series::FrameInfo> index;
+        
+        time_series::State state;
+        int current = -1; // The index of the frame which state corresponds to.
+    
+    public:
+        TimeSeriesReader(const std::string& filename) : file(filename.data(), std::ios::binary)
+        {
+            char magic[8];
+            if (!file.read(magic, sizeof(magic)) || memcmp(magic, time_series::MAGIC, sizeof(magic)) != 0)
+            {
+                std::cerr << "ERROR: " << filename << " is not a time series file." << std::endl;
+                return;
+            }
+            file.read(reinterpret_cast<char*>(&type), sizeof(type));
+            file.read(reinterpret_cast<char*>(&quantum), sizeof(quantum));
+            unsigned long long frames_begin = static_cast<unsigned long long>(file.tellg());
+            
+            if (!read_index())
+            {
+                scan(frames_begin);
+            }
+        }
+        
+        /**
+         Returns the time steps which are stored in the file.
+         */
+        std::vector<int> get_time_steps() const
+        {
+            std::vector<int> time_steps;
+            for (auto& info : index)
+            {
+                time_steps.push_back(info.time_step);
+            }
+            return time_steps;
+        }
+        
+        /**
+         Reads the mesh at the given time step in the format of ISMesh::extract_tet_mesh, with the nodes and tetrahedra in the order of their keys.
+         Returns false if the time step is not stored.
+         */
+        bool read(int time_step, std::vector<vec3>& points, std::vector<int>& tets, std::vector<int>& tet_labels)
+        {
+            int target = -1;
+            for (unsigned int i = 0; i < index.size(); i++)
+            {
+                if (index[i].time_step == time_step)
+                {
+                    target = static_cast<int>(i);
+                }
+            }
+            if (target == -1)
+            {
+                return false;
+            }
+            
+            int keyframe = target;
+            while (!index[keyframe].keyframe)
+            {
+                keyframe--;
+            }
+            if (current < keyframe || current > target)
+            {
+                state.clear();
+                current = keyframe - 1;
+            }
+            while (current < target)
+            {
+                current++;
+                apply(index[current]);
+            }
+            
+            points.clear();
+            tets.clear();
+            tet_labels.clear();
+            std::vector<int> indices(state.node_exists.size(), -1);
+            for (unsigned int k = 0; k < state.node_exists.size(); k++)
+            {
+                if (state.node_exists[k])
+                {
+                    indices[k] = static_cast<int>(points.size());
+                    auto& p = state.positions[k];
+                    real scale = quantum > 0. ? static_cast<real>(quantum) : 1.;
+                    points.push_back(scale*vec3(p[0], p[1], p[2]));
+                }
+            }
+            for (unsigned int k = 0; k < state.tet_exists.size(); k++)
+            {
+                if (state.tet_exists[k])
+                {
+                    for (auto n : state.tet_nodes[k])
+                    {
+                        tets.push_back(indices[n]);
+                    }
+                    tet_labels.push_back(state.tet_labels[k]);
+                }
+            }
+            return true;
+        }
+    
+    private:
+        bool read_index()
+        {
+            file.seekg(0, std::ios::end);
+            long long end = static_cast<long long>(file.tellg());
+            char tag[8];
+            unsigned long long index_offset;
+            if (end < static_cast<long long>(sizeof(tag) + sizeof(index_offset)))
+            {
+                return false;
+            }
+            file.seekg(end - sizeof(tag) - sizeof(index_offset));
+            file.read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset));
+            file.read(tag, sizeof(tag));
+            if (!file || memcmp(tag, time_series::INDEX_TAG, sizeof(tag)) != 0)
+            {
+                file.clear();
+                return false;
+            }
+            
+            file.seekg(index_offset + sizeof(tag));
+            unsigned int no_frames;
+            file.read(reinterpret_cast<char*>(&no_frames), sizeof(no_frames));
+            index.resize(no_frames);
+            for (auto& info : index)
+            {
+                char keyframe;
+                file.read(reinterpret_cast<char*>(&info.time_step), sizeof(info.time_step));
+                file.read(&keyframe, sizeof(keyframe));
+                file.read(reinterpret_cast<char*>(&info.offset), sizeof(info.offset));
+                info.keyframe = keyframe != 0;
+            }
+            return static_cast<bool>(file);
+        }
+        
+        /**
+         Builds the index from the frames. It stops at the index tag or at a frame which is cut off.
+         */
+        void scan(unsigned long long offset)
+        {
+            index.clear();
+            file.clear();
+            file.seekg(0, std::ios::end);
+            unsigned long long end = static_cast<unsigned long long>(file.tellg());
+            while (offset + sizeof(unsigned int) + sizeof(int) + 1 <= end)
+            {
+                file.seekg(offset);
+                char tag[8];
+                file.read(tag, sizeof(tag));
+                if (!file || memcmp(tag, time_series::INDEX_TAG, sizeof(tag)) == 0)
+                {
+                    break;
+                }
+                file.seekg(offset);
+                unsigned int size;
+                int time_step;
+                char keyframe;
+                file.read(reinterpret_cast<char*>(&size), sizeof(size));
+                file.read(reinterpret_cast<char*>(&time_step), sizeof(time_step));
+                file.read(&keyframe, sizeof(keyframe));
+                if (!file || offset + sizeof(size) + size > end)
+                {
+                    break;
+                }
+                index.push_back({time_step, keyframe != 0, offset});
+                offset += sizeof(size) + size;
+            }
+            while (!index.empty() && !index.front().keyframe)
+            {
+                index.erase(index.begin());
+            }
+            file.clear();
+        }
+        
+        void apply(const time_series::FrameInfo& info)
+        {
+            using namespace time_series;
+            file.seekg(info.offset);
+            unsigned int size;
+            file.read(reinterpret_cast<char*>(&size), sizeof(size));
+            std::vector<char> data(size);
+            file.read(data.data(), size);
+            const char* d = data.data();
+            
+            read_value<int>(d); // The time step.
+            if (read_value<char>(d))
+            {
+                state.clear();
+            }
+            
+            unsigned int no_removed = read_value<unsigned int>(d);
+            for (unsigned int i = 0; i < no_removed; i++)
+            {
+                state.node_exists[read_value<unsigned int>(d)] = false;
+            }
+            unsigned int no_changed = read_value<unsigned int>(d);
+            for (unsigned int i = 0; i < no_changed; i++)
+            {
+                unsigned int k = read_value<unsigned int>(d);
+                std::array<real, 3> p;
+                for (auto& v : p)
+                {
+                    if (type == 0)
+                    {
+                        v = static_cast<real>(read_value<int>(d));
+                    }
+                    else if (type == sizeof(float)) {
+                        v = static_cast<real>(read_value<float>(d));
+                    }
+                    else {
+                        v = static_cast<real>(read_value<double>(d));
+                    }
+                }
+                state.add_node(k, p);
+            }
+            
+            no_removed = read_value<unsigned int>(d);
+            for (unsigned int i = 0; i < no_removed; i++)
+            {
+                state.tet_exists[read_value<unsigned int>(d)] = false;
+            }
+            no_changed = read_value<unsigned int>(d);
+            for (unsigned int i = 0; i < no_changed; i++)
+            {
+                unsigned int k = read_value<unsigned int>(d);
+                std::array<unsigned int, 4> nodes;
+                for (auto& n : nodes)
+                {
+                    n = read_value<unsigned int>(d);
+                }
+                state.add_tet(k, nodes, read_value<int>(d));
+            }
+        }
+    };
+}
@@ -0,0 +1,205 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL thread_local
+#endif
+
+namespace Util
+{
+    /**
+     Records begin and end events of named scopes, for example the operations of deform, and writes them in the Chrome trace event format which
+     can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing. Each thread writes to its own ring buffer without locking. When a buffer is
+     full, its oldest events are overwritten. Tracing is disabled by default, and then a scope only costs a check of an atomic flag.
+     The names must be string literals or outlive the trace in another way.
+     */
+    class Trace
+    {
+    public:
+        typedef std::chrono::steady_clock clock;
+        
+        struct Event
+        {
+            const char* name;
+            clock::time_point time;
+            char phase; // 'B' for begin or 'E' for end.
+            int thread;
+        };
+        
+        /**
+         Records a begin event at construction and an end event at destruction if tracing is enabled at construction.
+         */
+        class Scope
+        {
+            const char* name;
+            bool active;
+        
+        public:
+            Scope(const char* name_) : name(name_), active(is_enabled())
+            {
+                if (active)
+                {
+                    add(name, 'B', clock::now());
+                }
+            }
+            
+            ~Scope()
+            {
+                if (active)
+                {
+                    add(name, 'E', clock::now());
+                }
+            }
+        };
+        
+        const static unsigned int BUFFER_SIZE = 1 << 16;
+    
+    private:
+        struct Buffer
+        {
+            std::vector<Event> events = std::vector<Event>(BUFFER_SIZE);
+            std::atomic<unsigned long long> head {0}; // The number of events written to the buffer.
+            unsigned long long tail = 0; // The number of events collected from the buffer.
+        };
+        
+        struct State
+        {
+            std::atomic<bool> enabled {false};
+            clock::time_point start = clock::now();
+            std::mutex mutex; // Guards the list of buffers.
+            std::vector<std::unique_ptr<Buffer>> buffers;
+        };
+        
+        static State& state()
+        {
+            static State s;
+            return s;
+        }
+        
+        /**
+         Returns the buffer of the calling thread. The buffer is created the first time a thread records an event and lives until the program ends.
+         */
+        static Buffer& local_buffer(int& thread)
+        {
+            static TRACE_THREAD_LOCAL Buffer* buffer = nullptr;
+            static TRACE_THREAD_LOCAL int index = 0;
+            if (!buffer)
+            {
+                State& s = state();
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.buffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+                buffer = s.buffers.back().get();
+                index = static_cast<int>(s.buffers.size());
+            }
+            thread = index;
+            return *buffer;
+        }
+    
+    public:
+        static void set_enabled(bool enabled)
+        {
+            state().enabled.store(enabled, std::memory_order_relaxed);
+        }
+        
+        static bool is_enabled()
+        {
+            return state().enabled.load(std::memory_order_relaxed);
+        }
+        
+        /**
+         Records an event with the given phase ('B' or 'E') and time on the calling thread.
+         */
+        static void add(const char* name, char phase, clock::time_point time)
+        {
+            int thread;
+            Buffer& buffer = local_buffer(thread);
+            unsigned long long head = buffer.head.load(std::memory_order_relaxed);
+            buffer.events[head % BUFFER_SIZE] = {name, time, phase, thread};
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+        
+        /**
+         Records a scope which ended now and lasted the given number of seconds. Used when the duration is measured anyway.
+         */
+        static void add(const char* name, double duration)
+        {
+            if (is_enabled())
+            {
+                clock::time_point end = clock::now();
+                add(name, 'B', end - std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(duration)));
+                add(name, 'E', end);
+            }
+        }
+        
+        /**
+         Returns the events of all threads recorded since the last call, ordered by thread and time. It should be called while the other threads
+         record few events, for example between time steps, since an event which is overwritten while it is copied is garbled.
+         */
+        static std::vector<Event> collect()
+        {
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            std::vector<Event> events;
+            for (auto& buffer : s.buffers)
+            {
+                unsigned long long head = buffer->head.load(std::memory_order_acquire);
+                unsigned long long tail = head - buffer->tail > BUFFER_SIZE ? head - BUFFER_SIZE : buffer->tail;
+                for (unsigned long long i = tail; i < head; i++)
+                {
+                    events.push_back(buffer->events[i % BUFFER_SIZE]);
+                }
+                buffer->tail = head;
+            }
+            return events;
+        }
+        
+        /**
+         Writes the events to a JSON file in the Chrome trace event format. The times are in microseconds since the first use of the trace.
+         Returns false if the file could not be opened.
+         */
+        static bool write(const std::string& file_name, const std::vector<Event>& events)
+        {
+            std::ofstream file(file_name);
+            if (!file)
+            {
+                return false;
+            }
+            clock::time_point start = state().start;
+            file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+            for (unsigned int i = 0; i < events.size(); i++)
+            {
+                const Event& e = events[i];
+                std::chrono::duration<double, std::micro> t = e.time - start;
+                file << (i == 0 ? "\n" : ",\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase << "\", \"ts\": " << std::fixed << t.count()
+                    << ", \"pid\": 0, \"tid\": " << e.thread << "}";
+            }
+            file << "\n]}" << std::endl;
+            return true;
+        }
+    };
+}
@@ -16,19 +16,37 @@
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
+#include <array>
 #include <list>
 #include <map>
 #include <sstream>
 #include <cmath>
 #include <cassert>
 #include <limits>
+#include <mutex>
 
 #include <CGLA/Vec3d.h>
 #include <CGLA/Vec4d.h>
 #include <CGLA/Mat3x3d.h>
 #include <CGLA/Mat4x4d.h>
 
+// Define DSC_SINGLE_PRECISION to store and compute in single precision. The orientation-sensitive predicates (signed volumes and ray-plane intersections) are still evaluated in double precision.
+#ifdef DSC_SINGLE_PRECISION
+#include <CGLA/Vec3f.h>
+#include <CGLA/Vec4f.h>
+#include <CGLA/Mat3x3f.h>
+#include <CGLA/Mat4x4f.h>
+
+typedef float             real;
+typedef CGLA::Vec3f       vec3;
+typedef CGLA::Vec4f       vec4;
+typedef CGLA::Mat3x3f     mat3;
+typedef CGLA::Mat4x4f     mat4;
+
+static const real EPSILON = 1e-5f;
+#else
 typedef double            real;
 typedef CGLA::Vec3d       vec3;
 typedef CGLA::Vec4d       vec4;
@@ -36,10 +54,15 @@ typedef CGLA::Mat3x3d     mat3;
 typedef CGLA::Mat4x4d     mat4;
 
 static const real EPSILON = 1e-8;
+#endif
 
 #undef INFINITY
 static const real INFINITY = std::numeric_limits<real>::max();;
 
+// Shewchuk's robust predicates which are compiled with TetGen (see TetGen/predicates.cxx).
+void exactinit(int verbose, int noexact, int nofilter, double maxx, double maxy, double maxz);
+double orient3dadapt(double* pa, double* pb, double* pc, double* pd, double permanent);
+
 namespace Util
 {
     using CGLA::isnan;
@@ -59,6 +82,18 @@ namespace Util
         return std::max(x, y);
     }
     
+    /**
+     * Returns the matrix which rotates by the angle around the axis.
+     */
+    inline mat3 rotation(CGLA::Axis axis, real angle)
+    {
+#ifdef DSC_SINGLE_PRECISION
+        return CGLA::rotation_Mat3x3f(axis, angle);
+#else
+        return CGLA::rotation_Mat3x3d(axis, angle);
+#endif
+    }
+    
     template <typename vec3>
     inline vec3 normal_direction(const vec3& a, const vec3& b, const vec3& c);
     
@@ -78,10 +113,68 @@ namespace Util
         return 0.5 * length(cross(v1-v0, v2-v0));
     }
     
+    /**
+     * Returns p in double precision which is used for evaluating orientation-sensitive predicates.
+     */
+    inline const CGLA::Vec3d& to_double(const CGLA::Vec3d& p)
+    {
+        return p;
+    }
+    
+    inline CGLA::Vec3d to_double(const CGLA::Vec3f& p)
+    {
+        return CGLA::Vec3d(p);
+    }
+    
+    /**
+     * Initializes the adaptive precision predicates in TetGen/predicates.cxx once. It is safe to call from several threads at once.
+     */
+    inline void init_predicates()
+    {
+        static std::once_flag initialized;
+        std::call_once(initialized, []() { exactinit(0, 0, 1, 1., 1., 1.); });
+    }
+    
+    /**
+     * Returns six times the signed volume of the tetrahedron |abcd|, i.e. dot(a-d, cross(b-d, c-d)). The sign is exact: The determinant is evaluated in floating point and only if it is smaller than the error bound, is it evaluated again using Shewchuk's adaptive precision arithmetic in TetGen/predicates.cxx.
+     */
+    inline double orient3d(const CGLA::Vec3d& a, const CGLA::Vec3d& b, const CGLA::Vec3d& c, const CGLA::Vec3d& d)
+    {
+        double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+        double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+        double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+        
+        double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+        double cdxady = cdx * ady, adxcdy = adx * cdy;
+        double adxbdy = adx * bdy, bdxady = bdx * ady;
+        
+        double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+        double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * std::abs(adz)
+                         + (std::abs(cdxady) + std::abs(adxcdy)) * std::abs(bdz)
+                         + (std::abs(adxbdy) + std::abs(bdxady)) * std::abs(cdz);
+        
+        // The error bound of the floating point evaluation, (7 + 56 eps) eps where eps = 2^-53.
+        const double ERROR_BOUND_A = 7.7715611723761027e-16;
+        if (det > ERROR_BOUND_A * permanent || -det > ERROR_BOUND_A * permanent)
+        {
+            return det;
+        }
+        
+        init_predicates();
+        double pa[] = {a[0], a[1], a[2]}, pb[] = {b[0], b[1], b[2]}, pc[] = {c[0], c[1], c[2]}, pd[] = {d[0], d[1], d[2]};
+        return orient3dadapt(pa, pb, pc, pd, permanent);
+    }
+    
+    template <typename vec3>
+    inline double orient3d(const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+    {
+        return orient3d(to_double(a), to_double(b), to_double(c), to_double(d));
+    }
+    
     template <typename real, typename vec3>
     inline real signed_volume(const vec3& a, const vec3& b, const vec3& c, const vec3& d)
     {
-        return dot(a-d, cross(b-d, c-d))/6.;
+        return static_cast<real>(orient3d(a, b, c, d)/6.);
     }
     
     template <typename real, typename vec3>
@@ -114,9 +207,9 @@ namespace Util
      * Calculate the cosine of angles in the triangle defined by the vertices a, b and c.
      */
     template <typename real, typename vec3>
-    inline std::vector<real> cos_angles(const vec3& a, const vec3& b, const vec3& c)
+    inline std::array<real, 3> cos_angles(const vec3& a, const vec3& b, const vec3& c)
     {
-        std::vector<real> cosines(3);
+        std::array<real, 3> cosines;
         cosines[0] = cos_angle<real>(a, b, c);
         cosines[1] = cos_angle<real>(b, c, a);
         cosines[2] = cos_angle<real>(c, a, b);
@@ -126,7 +219,7 @@ namespace Util
     template <typename real, typename vec3>
     inline real cos_min_angle(const vec3& a, const vec3& b, const vec3& c)
     {
-        std::vector<real> cosines = cos_angles<real>(a, b, c);
+        std::array<real, 3> cosines = cos_angles<real>(a, b, c);
         real max_cos = -1.;
         for(auto cos : cosines)
         {
@@ -144,7 +237,7 @@ namespace Util
     template <typename real, typename vec3>
     inline real cos_max_angle(const vec3& a, const vec3& b, const vec3& c)
     {
-        std::vector<real> cosines = cos_angles<real>(a, b, c);
+        std::array<real, 3> cosines = cos_angles<real>(a, b, c);
         real min_cos = 1.;
         for(auto cos : cosines)
         {
@@ -206,9 +299,9 @@ namespace Util
      * Finds the barycentric coordinates of point v in a triangle spanned by the vertices a, b and c.
      */
     template <typename real, typename vec3>
-    inline std::vector<real> barycentric_coords(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
+    inline std::array<real, 3> barycentric_coords(const vec3& p, const vec3& a, const vec3& b, const vec3& c)
     {
-        std::vector<real> coords(3);
+        std::array<real, 3> coords;
         
         vec3 v0 = b - a;
         vec3 v1 = c - a;
@@ -233,9 +326,9 @@ namespace Util
      * Calculates the barycentric coordinates of a point v in a tetrahedron spanned by the four vertices a, b, c and d.
      */
     template <typename real, typename vec3>
-    inline std::vector<real> barycentric_coords(const vec3& p, const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+    inline std::array<real, 4> barycentric_coords(const vec3& p, const vec3& a, const vec3& b, const vec3& c, const vec3& d)
     {
-        std::vector<real> coords(4);
+        std::array<real, 4> coords;
         coords[0] = signed_volume<real>(p, b, c, d);
         coords[1] = signed_volume<real>(a, p, c, d);
         coords[2] = signed_volume<real>(a, b, p, d);
@@ -335,6 +428,119 @@ namespace Util
         return q;
     }
     
+    /**
+     * The number of tetrahedra evaluated by each call of the batch kernels.
+     */
+    const unsigned int BATCH_SIZE = 8;
+    
+    /**
+     * The vertex positions of BATCH_SIZE tetrahedra in structure of arrays layout, i.e. x[i][k] is the x-coordinate of the i'th vertex of the k'th tetrahedron.
+     * The layout allows the compiler to vectorize the batch kernels over the tetrahedra.
+     */
+    template<typename real>
+    struct TetrahedronBatch
+    {
+        real x[4][BATCH_SIZE], y[4][BATCH_SIZE], z[4][BATCH_SIZE];
+        
+        template<typename vec3>
+        void set(unsigned int k, const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+        {
+            const vec3* verts[] = {&a, &b, &c, &d};
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                x[i][k] = (*verts[i])[0];
+                y[i][k] = (*verts[i])[1];
+                z[i][k] = (*verts[i])[2];
+            }
+        }
+        
+        /**
+         * Fills the unused part of a batch of n < BATCH_SIZE tetrahedra with copies of the last tetrahedron.
+         */
+        void pad(unsigned int n)
+        {
+            for (unsigned int k = n; k < BATCH_SIZE; ++k)
+            {
+                for (unsigned int i = 0; i < 4; ++i)
+                {
+                    x[i][k] = x[i][n-1];
+                    y[i][k] = y[i][n-1];
+                    z[i][k] = z[i][n-1];
+                }
+            }
+        }
+    };
+    
+    /**
+     * Calculates the quality (see quality) of each of the tetrahedra in the batch. The volume is evaluated in floating point only.
+     */
+    template<typename real>
+    inline void qualities(const TetrahedronBatch<real>& batch, real q[BATCH_SIZE])
+    {
+        const real (&x)[4][BATCH_SIZE] = batch.x, (&y)[4][BATCH_SIZE] = batch.y, (&z)[4][BATCH_SIZE] = batch.z;
+        for (unsigned int k = 0; k < BATCH_SIZE; ++k)
+        {
+            real adx = x[0][k] - x[3][k], ady = y[0][k] - y[3][k], adz = z[0][k] - z[3][k];
+            real bdx = x[1][k] - x[3][k], bdy = y[1][k] - y[3][k], bdz = z[1][k] - z[3][k];
+            real cdx = x[2][k] - x[3][k], cdy = y[2][k] - y[3][k], cdz = z[2][k] - z[3][k];
+            real v = (adz * (bdx * cdy - cdx * bdy) + bdz * (cdx * ady - adx * cdy) + cdz * (adx * bdy - bdx * ady)) / static_cast<real>(6.);
+            
+            real abx = x[0][k] - x[1][k], aby = y[0][k] - y[1][k], abz = z[0][k] - z[1][k];
+            real acx = x[0][k] - x[2][k], acy = y[0][k] - y[2][k], acz = z[0][k] - z[2][k];
+            real bcx = x[1][k] - x[2][k], bcy = y[1][k] - y[2][k], bcz = z[1][k] - z[2][k];
+            real ms = abx*abx + aby*aby + abz*abz;
+            ms += acx*acx + acy*acy + acz*acz;
+            ms += adx*adx + ady*ady + adz*adz;
+            ms += bcx*bcx + bcy*bcy + bcz*bcz;
+            ms += bdx*bdx + bdy*bdy + bdz*bdz;
+            ms += cdx*cdx + cdy*cdy + cdz*cdz;
+            real lrms = std::sqrt(ms / static_cast<real>(6.));
+            
+            q[k] = static_cast<real>(8.48528) * v / (lrms * lrms * lrms);
+        }
+    }
+    
+    /**
+     * Calculates the cosines to the six dihedral angles of each of the tetrahedra in the batch. The angles are ordered by the edges |01|, |02|, |03|, |12|, |13| and |23| like in cos_dihedral_angle.
+     * The normal of each face is only computed once.
+     */
+    template<typename real>
+    inline void cos_dihedral_angles(const TetrahedronBatch<real>& batch, real cos_angles[6][BATCH_SIZE])
+    {
+        const real (&x)[4][BATCH_SIZE] = batch.x, (&y)[4][BATCH_SIZE] = batch.y, (&z)[4][BATCH_SIZE] = batch.z;
+        // The corners of the face opposite to corner i in increasing order.
+        const unsigned int faces[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+        real nx[4][BATCH_SIZE], ny[4][BATCH_SIZE], nz[4][BATCH_SIZE];
+        for (unsigned int f = 0; f < 4; ++f)
+        {
+            unsigned int a = faces[f][0], b = faces[f][1], c = faces[f][2];
+            for (unsigned int k = 0; k < BATCH_SIZE; ++k)
+            {
+                real abx = x[b][k] - x[a][k], aby = y[b][k] - y[a][k], abz = z[b][k] - z[a][k];
+                real acx = x[c][k] - x[a][k], acy = y[c][k] - y[a][k], acz = z[c][k] - z[a][k];
+                real n0 = aby * acz - abz * acy;
+                real n1 = abz * acx - abx * acz;
+                real n2 = abx * acy - aby * acx;
+                real l = std::sqrt(n0*n0 + n1*n1 + n2*n2);
+                nx[f][k] = n0 / l;
+                ny[f][k] = n1 / l;
+                nz[f][k] = n2 / l;
+            }
+        }
+        
+        // For each edge, the two faces which share it and the sign which turns the dot product of their normals into the cosine to the dihedral angle.
+        const unsigned int edge_faces[6][2] = {{3, 2}, {3, 1}, {2, 1}, {3, 0}, {2, 0}, {1, 0}};
+        const real signs[6] = {-1., 1., -1., -1., 1., -1.};
+        for (unsigned int e = 0; e < 6; ++e)
+        {
+            unsigned int f1 = edge_faces[e][0], f2 = edge_faces[e][1];
+            for (unsigned int k = 0; k < BATCH_SIZE; ++k)
+            {
+                cos_angles[e][k] = signs[e] * (nx[f1][k] * nx[f2][k] + ny[f1][k] * ny[f2][k] + nz[f1][k] * nz[f2][k]);
+            }
+        }
+    }
+    
     /**
      * Returns whether the point p is on the inside (in the direction away from the normal) from the plane defined by the point a and the normal.
      */
@@ -556,8 +762,9 @@ namespace Util
     template<typename real, typename vec3>
     inline real intersection_ray_plane(const vec3& p, const vec3& r, const vec3& a, const vec3& normal)
     {
-        real n = dot(normal, a - p);
-        real d = dot(normal, r);
+        CGLA::Vec3d normal_ = to_double(normal);
+        double n = dot(normal_, to_double(a) - to_double(p));
+        double d = dot(normal_, to_double(r));
         
         if (std::abs(d) < EPSILON) // Plane and line are parallel if true.
         {
@@ -569,7 +776,7 @@ namespace Util
         }
         
         // Compute the t value for the directed line ray intersecting the plane.
-        return n / d;
+        return static_cast<real>(n / d);
     }
     
     /**
@@ -594,7 +801,7 @@ namespace Util
             return t;
         }
         
-        std::vector<real> coords = barycentric_coords<real>(p + t*r, a, b, c);
+        std::array<real, 3> coords = barycentric_coords<real>(p + t*r, a, b, c);
         if(coords[0] > EPSILON && coords[1] > EPSILON && coords[2] > EPSILON) // The intersection happens inside the triangle.
         {
             return t;
@@ -634,4 +841,65 @@ namespace Util
         }
         return max_diff;
     }
+    
+    /**
+     Writes the bytes of a trivially copyable value to a binary stream.
+     */
+    template<typename T>
+    inline void write_binary(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    
+    /**
+     Writes the size and the bytes of the trivially copyable values to a binary stream.
+     */
+    template<typename T>
+    inline void write_binary(std::ostream& os, const std::vector<T>& values)
+    {
+        unsigned long long size = values.size();
+        write_binary(os, size);
+        os.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(T));
+    }
+    
+    /**
+     Reads a value written by write_binary.
+     */
+    template<typename T>
+    inline void read_binary(std::istream& is, T& value)
+    {
+        is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+    
+    /**
+     Reads values written by write_binary. The values are left empty if the stream fails. The failbit is set if the size is larger than the rest of the stream, so a corrupt size does not allocate the values.
+     */
+    template<typename T>
+    inline void read_binary(std::istream& is, std::vector<T>& values)
+    {
+        unsigned long long size = 0;
+        read_binary(is, size);
+        values.clear();
+        unsigned long long max_size = std::numeric_limits<size_t>::max()/sizeof(T);
+        std::streampos pos = is.tellg();
+        if (is && pos != std::streampos(-1))
+        {
+            is.seekg(0, std::ios::end);
+            max_size = std::min(max_size, static_cast<unsigned long long>(is.tellg() - pos)/sizeof(T));
+            is.seekg(pos);
+        }
+        if (size > max_size)
+        {
+            is.setstate(std::ios::failbit);
+        }
+        if (is)
+        {
+            values.resize(static_cast<size_t>(size));
+            is.read(reinterpret_cast<char*>(values.data()), values.size()*sizeof(T));
+        }
+        if (!is)
+        {
+            values.clear();
+        }
+    }
 }
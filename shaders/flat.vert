@@ -0,0 +1,17 @@
+#version 150
+
+uniform mat4 MVMatrix;
+uniform mat4 MVPMatrix;
+
+in vec3 position;
+
+out vec3 positionV;
+
+void main()
+{
+    // The colour is calculated in the geometry shader from the normal of the face
+    positionV = (MVMatrix * vec4(position.xyz, 1.)).xyz;
+    
+    // Calculate position
+    gl_Position = MVPMatrix * vec4(position.xyz, 1.);
+}
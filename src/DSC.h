@@ -16,9 +16,17 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <map>
+#include <set>
+#include <sstream>
+
 #include "is_mesh.h"
 #include "attributes.h"
 #include "geometry.h"
+#include "sizing_field.h"
+#include "metrics.h"
 
 struct parameters {
     
@@ -59,6 +67,10 @@ namespace DSC {
         typedef is_mesh::FaceKey      face_key;
         typedef is_mesh::TetrahedronKey       tet_key;
         
+        /// The operations of a deformation in the order they are performed by resume_deform.
+        enum DeformOperation {MOVE_VERTICES, SMOOTH, TOPOLOGICAL_EDGE_REMOVAL, TOPOLOGICAL_FACE_REMOVAL, REMOVE_DEGENERATE_TETS, REMOVE_DEGENERATE_FACES, REMOVE_DEGENERATE_EDGES,
+            THICKENING_INTERFACE, THINNING_INTERFACE, THICKENING, THINNING, FINISH, IDLE};
+        
     protected:
         MultipleGeometry design_domain;
         
@@ -67,11 +79,40 @@ namespace DSC {
         real AVG_AREA;
         real AVG_VOLUME;
         
+        // The target edge length at a point (see set_sizing_field).
+        std::function<real(const vec3&)> sizing_field;
+        
+        // Tetrahedralizes cavities of degenerate tetrahedra (see set_cavity_tetralizer).
+        std::function<bool(std::vector<vec3>&, const std::vector<int>&, std::vector<int>&)> cavity_tetralizer;
+        
         // Should be eliminated
         real FLIP_EDGE_INTERFACE_FLATNESS = 0.995;
         
         parameters pars;
         
+        // The state of the current deformation.
+        DeformOperation deform_operation = IDLE;
+        int deform_num_steps = 0;
+        int deform_step = 0;
+        int deform_missing = 0;
+        int deform_operations = 0;
+        bool deform_resized = false;
+        int deform_count = 0;
+        
+        // Whether the passes print their results (see set_verbose) and the metrics of the operations of deform (see get_metrics).
+        bool verbose = true;
+        std::array<OperationMetrics, IDLE> metrics;
+        
+        // Narrow band mode (see set_narrow_band).
+        int NARROW_BAND = -1;
+        int FAR_FIELD_INTERVAL = 0;
+        bool band_active = false;
+        unsigned int band_generation = 0;
+        std::vector<node_key> band_nodes;
+        std::vector<std::pair<unsigned int, int>> band_rings; // The generation in which each node was reached and its distance in rings to the interface.
+        unsigned int band_stamp = 0;
+        std::vector<unsigned int> band_stamps; // Marks the simplices which are already added by add_band_simplex.
+        
         //////////////////////////
         // INITIALIZE FUNCTIONS //
         //////////////////////////
@@ -79,19 +120,43 @@ namespace DSC {
     public:
         
         /// SimplicialComplex constructor.
-        DeformableSimplicialComplex(real avg_edge_length, std::vector<vec3> & points, std::vector<int> & tets, const std::vector<int>& tet_labels):
+        DeformableSimplicialComplex(real avg_edge_length, const std::vector<vec3> & points, const std::vector<int> & tets, const std::vector<int>& tet_labels):
             is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>(points, tets, tet_labels)
         {
             pars = {0.1, 0.5, 0.0005, 0.015, 0.02, 0.3, 0., 2., 0.2, 5., 0.2, INFINITY};
             set_avg_edge_length(avg_edge_length);
         }
         
+        /// Restarts a simplicial complex from a binary stream written by save_state. The design domain, sizing field and cavity tetralizer are not stored and must be set again. If the stream could not be read, the failbit of the stream is set and the complex should not be used.
+        DeformableSimplicialComplex(std::istream& is):
+            is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>(is)
+        {
+            if (is && !load_parameters(is))
+            {
+                std::cerr << "ERROR: The state of the simplicial complex could not be read." << std::endl;
+            }
+        }
+        
         ~DeformableSimplicialComplex()
         {
             
         }
         
+        /**
+         * Returns a fork of the simplicial complex for speculative steps, for example the trial steps of a line search. The fork shares the
+         * pages of the kernels with this complex copy-on-write (see is_mesh::kernel), so forking is proportional to the number of pages, a step
+         * on the fork is proportional to the pages it changes, and discarding the fork only releases the pages it copied. The other members,
+         * including the narrow band (proportional to the number of nodes and simplices if it has been used) and the metrics, are copied.
+         * Changes to either complex are not seen by the other, but get_memory_usage of both counts the shared pages. The complex and its forks
+         * must not be changed concurrently from different threads. A derived class should fork by its own copy constructor.
+         */
+        std::unique_ptr<DeformableSimplicialComplex> fork() const
+        {
+            return std::unique_ptr<DeformableSimplicialComplex>(new DeformableSimplicialComplex(*this));
+        }
+        
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::get;
+        using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::get_mutable;
         
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::nodes_begin;
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::nodes_end;
@@ -126,6 +191,7 @@ namespace DSC {
         
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::split;
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::collapse;
+        using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::replace;
         
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::garbage_collect;
         using is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::exists;
@@ -139,11 +205,159 @@ namespace DSC {
             AVG_VOLUME = avg_edge_length*avg_edge_length*avg_edge_length*sqrt(2.)/12.;
         }
         
+        /**
+         * Sets the sizing field which gives the target edge length at any point, for example a SizingGrid. The thresholds of the resizing
+         * operations (MIN_LENGTH, MAX_LENGTH, MIN_VOLUME, MAX_VOLUME) and the edge quality are then relative to the target edge length at the
+         * midpoint of the edge or the barycenter of the tetrahedron instead of the average edge length. Thereby, the mesh is refined where
+         * the target is small and coarsened where it is large. An empty function restores the uniform target AVG_LENGTH.
+         */
+        void set_sizing_field(const std::function<real(const vec3&)>& f)
+        {
+            sizing_field = f;
+        }
+        
+        /**
+         * Returns the target edge length at the point p.
+         */
+        real get_target_length(const vec3& p) const
+        {
+            return sizing_field ? sizing_field(p) : AVG_LENGTH;
+        }
+        
+        /**
+         * Sets the function which remove_degenerate_tets uses to re-tetrahedralize a cavity around a degenerate tetrahedron which can not be
+         * collapsed. The function is given the boundary of the cavity as the triangles faces (three indices into points each) and should return
+         * the tetrahedra of the cavity (four indices into points each). It may add points to points inside the cavity, but it must preserve the
+         * boundary triangles exactly. It returns false on failure. Tetralizer::tetralize_cavity is an implementation by TetGen.
+         */
+        void set_cavity_tetralizer(const std::function<bool(std::vector<vec3>&, const std::vector<int>&, std::vector<int>&)>& f)
+        {
+            cavity_tetralizer = f;
+        }
+        
+        /**
+         * Sets whether the passes of deform print their results to std::cout. The metrics (see get_metrics) are collected regardless.
+         */
+        void set_verbose(bool v)
+        {
+            verbose = v;
+        }
+        
+        /**
+         * Returns the metrics of the given operation of deform accumulated since the last call to reset_metrics, for example the time spent
+         * smoothing and the number of nodes which are smoothed. The metrics are only collected if DSC_METRICS is defined, otherwise they are zero.
+         */
+        const OperationMetrics& get_metrics(DeformOperation operation) const
+        {
+            return metrics[operation];
+        }
+        
+        /**
+         * Resets the metrics of all the operations of deform, for example before each step.
+         */
+        void reset_metrics()
+        {
+            metrics.fill(OperationMetrics());
+        }
+        
+        /**
+         * Returns the name of the given operation of deform, for example "smooth". The operations are traced with these names (see Util::Trace).
+         */
+        static const char* get_operation_name(DeformOperation operation)
+        {
+            const static char* names[] = {"move vertices", "smooth", "topological edge removal", "topological face removal", "remove degenerate tets",
+                "remove degenerate faces", "remove degenerate edges", "thickening interface", "thinning interface", "thickening", "thinning", "finish", "idle"};
+            return names[operation];
+        }
+        
         void set_parameters(parameters pars_)
         {
             pars = pars_;
         }
         
+        /**
+         * Writes a checkpoint of the simplicial complex to a binary stream: the mesh in its native layout (see ISMesh::save_state), the parameters,
+         * the average edge length and the state of a deformation in progress and of the narrow band. A restart by load_state or the constructor
+         * taking a stream is then as fast as reading the stream, since neither the connectivity nor the flags are rebuilt. The design domain,
+         * sizing field and cavity tetralizer are functions and are not stored.
+         */
+        void save_state(std::ostream& os) const
+        {
+            is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::save_state(os);
+            real lengths[] = {AVG_LENGTH, AVG_AREA, AVG_VOLUME, FLIP_EDGE_INTERFACE_FLATNESS};
+            Util::write_binary(os, lengths);
+            Util::write_binary(os, pars);
+            int deform_state[] = {deform_operation, deform_num_steps, deform_step, deform_missing, deform_operations, deform_resized, deform_count};
+            Util::write_binary(os, deform_state);
+            int band_state[] = {NARROW_BAND, FAR_FIELD_INTERVAL, band_active};
+            Util::write_binary(os, band_state);
+            Util::write_binary(os, band_generation);
+            Util::write_binary(os, band_nodes);
+            Util::write_binary(os, band_rings);
+        }
+        
+        /**
+         * Replaces the simplicial complex by a checkpoint written by save_state. Returns false and sets the failbit of the stream if the stream
+         * could not be read, in which case the complex should not be used.
+         */
+        bool load_state(std::istream& is)
+        {
+            return is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::load_state(is) && load_parameters(is);
+        }
+    
+    private:
+        /**
+         * Reads the part of a checkpoint which follows the mesh (see save_state). The simplicial complex is unchanged if the stream fails or
+         * the state of the deformation is invalid, in which case the failbit is set.
+         */
+        bool load_parameters(std::istream& is)
+        {
+            real lengths[4];
+            parameters pars_;
+            int deform_state[7];
+            int band_state[3];
+            unsigned int generation;
+            std::vector<node_key> nodes;
+            std::vector<std::pair<unsigned int, int>> rings;
+            Util::read_binary(is, lengths);
+            Util::read_binary(is, pars_);
+            Util::read_binary(is, deform_state);
+            Util::read_binary(is, band_state);
+            Util::read_binary(is, generation);
+            Util::read_binary(is, nodes);
+            Util::read_binary(is, rings);
+            if (is && (deform_state[0] < 0 || deform_state[0] > IDLE))
+            {
+                is.setstate(std::ios::failbit);
+            }
+            if (!is)
+            {
+                return false;
+            }
+            
+            AVG_LENGTH = lengths[0];
+            AVG_AREA = lengths[1];
+            AVG_VOLUME = lengths[2];
+            FLIP_EDGE_INTERFACE_FLATNESS = lengths[3];
+            pars = pars_;
+            deform_operation = static_cast<DeformOperation>(deform_state[0]);
+            deform_num_steps = deform_state[1];
+            deform_step = deform_state[2];
+            deform_missing = deform_state[3];
+            deform_operations = deform_state[4];
+            deform_resized = deform_state[5] != 0;
+            deform_count = deform_state[6];
+            NARROW_BAND = band_state[0];
+            FAR_FIELD_INTERVAL = band_state[1];
+            band_active = band_state[2] != 0;
+            band_generation = generation;
+            band_nodes = nodes;
+            band_rings = rings;
+            return true;
+        }
+    
+    public:
+        
         void set_design_domain(Geometry *geometry)
         {
             design_domain.add_geometry(geometry);
@@ -158,6 +372,7 @@ namespace DSC {
                     set_label(tit.key(), label);
                 }
             }
+            band_nodes.clear(); // The interface is searched for among all nodes at the next update of the narrow band.
         }
         
     private:
@@ -286,10 +501,10 @@ namespace DSC {
          */
         void set_pos(const node_key& nid, const vec3& p)
         {
-            get(nid).set_pos(p);
+            get_mutable(nid).set_pos(p);
             if(!is_movable(nid))
             {
-                get(nid).set_destination(p);
+                get_mutable(nid).set_destination(p);
             }
         }
         
@@ -304,10 +519,10 @@ namespace DSC {
                 vec3 p = get_pos(nid);
                 vec3 vec = dest - p;
                 design_domain.clamp_vector(p, vec);
-                get(nid).set_destination(p + vec);
+                get_mutable(nid).set_destination(p + vec);
             }
             else {
-                get(nid).set_destination(get(nid).get_pos());
+                get_mutable(nid).set_destination(get(nid).get_pos());
             }
         }
         
@@ -351,6 +566,17 @@ namespace DSC {
             return design_domain;
         }
         
+        /**
+         * Returns the memory used by the simplicial complex, where the other bytes are used by the narrow band.
+         */
+        virtual is_mesh::MemoryUsage get_memory_usage(bool scan = true) const
+        {
+            is_mesh::MemoryUsage m = is_mesh::ISMesh<node_att, edge_att, face_att, tet_att>::get_memory_usage(scan);
+            m.other_bytes += band_nodes.capacity()*sizeof(node_key) + band_rings.capacity()*sizeof(std::pair<unsigned int, int>)
+                + band_stamps.capacity()*sizeof(unsigned int);
+            return m;
+        }
+        
         ////////////////////////
         // FIX MESH FUNCTIONS //
         ////////////////////////
@@ -604,13 +830,12 @@ namespace DSC {
         void topological_edge_removal()
         {
             std::vector<tet_key> tets;
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                if (quality(tit.key()) < pars.MIN_TET_QUALITY)
+            for_each_band_quality([&](const tet_key& t, real q) {
+                if (q < pars.MIN_TET_QUALITY)
                 {
-                    tets.push_back(tit.key());
+                    tets.push_back(t);
                 }
-            }
+            });
             
             // Attempt to remove each edge of each tetrahedron in tets. Accept if it increases the minimum quality locally.
             int i = 0, j = 0, k = 0;
@@ -640,7 +865,11 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Topological edge removals: " << i + k << "/" << j << " (" << k << " at interface)" << std::endl;
+            record(TOPOLOGICAL_EDGE_REMOVAL, static_cast<int>(tets.size()), j, i + k);
+            if (verbose)
+            {
+                std::cout << "Topological edge removals: " << i + k << "/" << j << " (" << k << " at interface)" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -761,13 +990,12 @@ namespace DSC {
         void topological_face_removal()
         {
             std::vector<tet_key> tets;
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                if (quality(tit.key()) < pars.MIN_TET_QUALITY)
+            for_each_band_quality([&](const tet_key& t, real q) {
+                if (q < pars.MIN_TET_QUALITY)
                 {
-                    tets.push_back(tit.key());
+                    tets.push_back(t);
                 }
-            }
+            });
             
             // Attempt to remove each face of each remaining tetrahedron in tets using multi-face removal.
             // Accept if it increases the minimum quality locally.
@@ -791,7 +1019,11 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Topological face removals: " << i << "/" << j << std::endl;
+            record(TOPOLOGICAL_FACE_REMOVAL, static_cast<int>(tets.size()), j, i);
+            if (verbose)
+            {
+                std::cout << "Topological face removals: " << i << "/" << j << std::endl;
+            }
             
             garbage_collect();
         }
@@ -811,23 +1043,27 @@ namespace DSC {
             }
             
             std::vector<edge_key> edges;
-            for (auto eit = edges_begin(); eit != edges_end(); eit++)
+            for (auto e : get_band_edges())
             {
-                if (eit->is_interface() && length(eit.key()) > pars.MAX_LENGTH*AVG_LENGTH)
+                if (get(e).is_interface() && length(e) > pars.MAX_LENGTH*target_length(e))
                 {
-                    edges.push_back(eit.key());
+                    edges.push_back(e);
                 }
             }
             int i = 0;
             for(auto &e : edges)
             {
-                if (exists(e) && (get(e).is_interface() || get(e).is_boundary()) && length(e) > pars.MAX_LENGTH*AVG_LENGTH && !is_flat(get_faces(e)))
+                if (exists(e) && (get(e).is_interface() || get(e).is_boundary()) && length(e) > pars.MAX_LENGTH*target_length(e) && !is_flat(get_faces(e)))
                 {
                     split(e);
                     i++;
                 }
             }
-            std::cout << "Thickening interface splits: " << i << std::endl;
+            record(THICKENING_INTERFACE, static_cast<int>(edges.size()), i, i);
+            if (verbose)
+            {
+                std::cout << "Thickening interface splits: " << i << std::endl;
+            }
         }
         
         /**
@@ -841,23 +1077,27 @@ namespace DSC {
             }
             
             std::vector<tet_key> tetrahedra;
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+            for (auto t : get_band_tets())
             {
-                if (volume(tit.key()) > pars.MAX_VOLUME*AVG_VOLUME)
+                if (volume(t) > pars.MAX_VOLUME*target_volume(t))
                 {
-                    tetrahedra.push_back(tit.key());
+                    tetrahedra.push_back(t);
                 }
             }
             int i = 0;
             for(auto &t : tetrahedra)
             {
-                if (is_unsafe_editable(t) && volume(t) > pars.MAX_VOLUME*AVG_VOLUME)
+                if (is_unsafe_editable(t) && volume(t) > pars.MAX_VOLUME*target_volume(t))
                 {
                     split(t);
                     i++;
                 }
             }
-            std::cout << "Thickening splits: " << i << std::endl;
+            record(THICKENING, static_cast<int>(tetrahedra.size()), i, i);
+            if (verbose)
+            {
+                std::cout << "Thickening splits: " << i << std::endl;
+            }
         }
         
         //////////////
@@ -872,17 +1112,17 @@ namespace DSC {
             }
             
             std::vector<edge_key> edges;
-            for (auto eit = edges_begin(); eit != edges_end(); eit++)
+            for (auto e : get_band_edges())
             {
-                if (eit->is_interface() && length(eit.key()) < pars.MIN_LENGTH*AVG_LENGTH)
+                if (get(e).is_interface() && length(e) < pars.MIN_LENGTH*target_length(e))
                 {
-                    edges.push_back(eit.key());
+                    edges.push_back(e);
                 }
             }
             int i = 0, j = 0;
             for(auto &e : edges)
             {
-                if (exists(e) && (get(e).is_interface() || get(e).is_boundary()) && length(e) < pars.MIN_LENGTH*AVG_LENGTH)
+                if (exists(e) && (get(e).is_interface() || get(e).is_boundary()) && length(e) < pars.MIN_LENGTH*target_length(e))
                 {
                     if(collapse(e))
                     {
@@ -891,7 +1131,11 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Thinning interface collapses: " << i << "/" << j << std::endl;
+            record(THINNING_INTERFACE, static_cast<int>(edges.size()), j, i);
+            if (verbose)
+            {
+                std::cout << "Thinning interface collapses: " << i << "/" << j << std::endl;
+            }
         }
         
         /**
@@ -905,17 +1149,17 @@ namespace DSC {
             }
             
             std::vector<tet_key> tetrahedra;
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+            for (auto t : get_band_tets())
             {
-                if (volume(tit.key()) < pars.MIN_VOLUME*AVG_VOLUME)
+                if (volume(t) < pars.MIN_VOLUME*target_volume(t))
                 {
-                    tetrahedra.push_back(tit.key());
+                    tetrahedra.push_back(t);
                 }
             }
             int i = 0, j = 0;
             for(auto &t : tetrahedra)
             {
-                if (is_unsafe_editable(t) && volume(t) < pars.MIN_VOLUME*AVG_VOLUME)
+                if (is_unsafe_editable(t) && volume(t) < pars.MIN_VOLUME*target_volume(t))
                 {
                     if(collapse(t))
                     {
@@ -924,7 +1168,11 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Thinning collapses: " << i << "/" << j << std::endl;
+            record(THINNING, static_cast<int>(tetrahedra.size()), j, i);
+            if (verbose)
+            {
+                std::cout << "Thinning collapses: " << i << "/" << j << std::endl;
+            }
         }
         
         /////////////////////////
@@ -936,26 +1184,36 @@ namespace DSC {
         void remove_degenerate_edges()
         {
             std::list<edge_key> edges;
-            for (auto eit = edges_begin(); eit != edges_end(); eit++)
+            for (auto e : get_band_edges())
             {
-                if (quality(eit.key()) < pars.DEG_EDGE_QUALITY)
+                if (quality(e) < pars.DEG_EDGE_QUALITY)
                 {
-                    edges.push_back(eit.key());
+                    edges.push_back(e);
                 }
             }
-            int i = 0, j = 0;
+            int i = 0, j = 0, l = 0;
             for(auto e : edges)
             {
-                if(exists(e) && quality(e) < pars.DEG_EDGE_QUALITY && !collapse(e))
+                if(exists(e) && quality(e) < pars.DEG_EDGE_QUALITY)
                 {
-                    if(collapse(e, false))
+                    if(collapse(e))
                     {
-                        i++;
+                        l++;
+                    }
+                    else {
+                        if(collapse(e, false))
+                        {
+                            i++;
+                        }
+                        j++;
                     }
-                    j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " degenerate edges" << std::endl;
+            record(REMOVE_DEGENERATE_EDGES, static_cast<int>(edges.size()), j + l, i + l);
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " degenerate edges" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -963,30 +1221,40 @@ namespace DSC {
         {
             std::list<face_key> faces;
             
-            for (auto fit = faces_begin(); fit != faces_end(); fit++)
+            for (auto f : get_band_faces())
             {
-                if(quality(fit.key()) < pars.DEG_FACE_QUALITY)
+                if(quality(f) < pars.DEG_FACE_QUALITY)
                 {
-                    faces.push_back(fit.key());
+                    faces.push_back(f);
                 }
             }
             
-            int i = 0, j = 0;
+            int i = 0, j = 0, l = 0;
             for (auto &f : faces)
             {
-                if (exists(f) && quality(f) < pars.DEG_FACE_QUALITY && !collapse(f))
+                if (exists(f) && quality(f) < pars.DEG_FACE_QUALITY)
                 {
-                    if(collapse(f, false))
+                    if(collapse(f))
                     {
-                        i++;
+                        l++;
                     }
                     else {
-                        split(longest_edge(get_edges(f)));
+                        if(collapse(f, false))
+                        {
+                            i++;
+                        }
+                        else {
+                            split(longest_edge(get_edges(f)));
+                        }
+                        j++;
                     }
-                    j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " degenerate faces" << std::endl;
+            record(REMOVE_DEGENERATE_FACES, static_cast<int>(faces.size()), j + l, i + l, j - i);
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " degenerate faces" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -994,29 +1262,43 @@ namespace DSC {
         {
             std::vector<tet_key> tets;
             
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                if (quality(tit.key()) < pars.DEG_TET_QUALITY)
+            for_each_band_quality([&](const tet_key& t, real q) {
+                if (q < pars.DEG_TET_QUALITY)
                 {
-                    tets.push_back(tit.key());
+                    tets.push_back(t);
                 }
-            }
-            int i = 0, j = 0;
+            });
+            int i = 0, j = 0, k = 0, l = 0;
             for (auto &t : tets)
             {
-                if (exists(t) && quality(t) < pars.DEG_TET_QUALITY && !collapse(t))
+                if (exists(t) && quality(t) < pars.DEG_TET_QUALITY)
                 {
-                    if(collapse(t, false))
+                    if(collapse(t))
                     {
-                        i++;
+                        l++;
                     }
                     else {
-                        split(longest_edge(get_edges(t)));
+                        if(collapse(t, false))
+                        {
+                            i++;
+                        }
+                        else if(remesh_cavity(t))
+                        {
+                            i++;
+                            k++;
+                        }
+                        else {
+                            split(longest_edge(get_edges(t)));
+                        }
+                        j++;
                     }
-                    j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " degenerate tets" << std::endl;
+            record(REMOVE_DEGENERATE_TETS, static_cast<int>(tets.size()), j + l, i + l, j - i);
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " degenerate tets (" << k << " by remeshing)" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -1030,11 +1312,11 @@ namespace DSC {
         void remove_edges()
         {
             std::list<edge_key> edges;
-            for (auto eit = edges_begin(); eit != edges_end(); eit++)
+            for (auto e : get_band_edges())
             {
-                if (quality(eit.key()) < pars.MIN_EDGE_QUALITY)
+                if (quality(e) < pars.MIN_EDGE_QUALITY)
                 {
-                    edges.push_back(eit.key());
+                    edges.push_back(e);
                 }
             }
             int i = 0, j = 0;
@@ -1049,7 +1331,10 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " low quality edges" << std::endl;
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " low quality edges" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -1106,11 +1391,11 @@ namespace DSC {
         {
             std::list<face_key> faces;
             
-            for (auto fit = faces_begin(); fit != faces_end(); fit++)
+            for (auto f : get_band_faces())
             {
-                if(quality(fit.key()) < pars.MIN_FACE_QUALITY)
+                if(quality(f) < pars.MIN_FACE_QUALITY)
                 {
-                    faces.push_back(fit.key());
+                    faces.push_back(f);
                 }
             }
             
@@ -1126,7 +1411,10 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " low quality faces" << std::endl;
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " low quality faces" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -1244,7 +1532,7 @@ namespace DSC {
             vec3 proj_apex = Util::project_point_plane(get_pos(apex), verts[0], verts[1], verts[2]);
             
             // Find barycentric coordinates
-            std::vector<real> barycentric_coords = Util::barycentric_coords<real>(proj_apex, verts[0], verts[1], verts[2]);
+            std::array<real, 3> barycentric_coords = Util::barycentric_coords<real>(proj_apex, verts[0], verts[1], verts[2]);
             
             if(barycentric_coords[0] > 0.2 && barycentric_coords[1] > 0.2 && barycentric_coords[2] > 0.2) // The tetrahedron is a cap
             {
@@ -1287,13 +1575,12 @@ namespace DSC {
         {
             std::vector<tet_key> tets;
             
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                if (quality(tit.key()) < pars.MIN_TET_QUALITY)
+            for_each_band_quality([&](const tet_key& t, real q) {
+                if (q < pars.MIN_TET_QUALITY)
                 {
-                    tets.push_back(tit.key());
+                    tets.push_back(t);
                 }
-            }
+            });
             int i = 0, j=0;
             for (auto &tet : tets)
             {
@@ -1306,7 +1593,10 @@ namespace DSC {
                     j++;
                 }
             }
-            std::cout << "Removed " << i <<"/"<< j << " low quality tets" << std::endl;
+            if (verbose)
+            {
+                std::cout << "Removed " << i <<"/"<< j << " low quality tets" << std::endl;
+            }
             garbage_collect();
         }
         
@@ -1339,18 +1629,21 @@ namespace DSC {
         void smooth()
         {
             int i = 0, j = 0;
-            for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
-            {
-                if (is_safe_editable(nit.key()))
+            for_each_band_node([&](const node_key& n) {
+                if (is_safe_editable(n))
                 {
-                    if (smart_laplacian(nit.key()))
+                    if (smart_laplacian(n))
                     {
                         i++;
                     }
                     j++;
                 }
+            });
+            record(SMOOTH, j, j, i);
+            if (verbose)
+            {
+                std::cout << "Smoothed: " << i << "/" << j << std::endl;
             }
-            std::cout << "Smoothed: " << i << "/" << j << std::endl;
         }
         
         ///////////////////
@@ -1386,143 +1679,553 @@ namespace DSC {
             fix_complex();
         }
         
-        ////////////////////
-        // MOVE FUNCTIONS //
-        ////////////////////
+        /////////////////
+        // NARROW BAND //
+        /////////////////
     public:
         /**
-         * Moves all the vertices to their destination which can be set by the set_destination() function.
+         * Enables the narrow band mode if rings is non-negative and disables it otherwise. In narrow band mode, the passes of deform only consider
+         * the simplices with a node within the given number of rings from the interface. Every far_field_interval'th deformation considers all
+         * simplices, such that the quality of the far field is still maintained (never if far_field_interval is not positive). The band passes leave
+         * more low quality tetrahedra which the later passes try to improve, so with longer intervals the narrow band mode can be slower than without it.
+         * The interface nodes are never smoothed, so the band should be at least one ring wide and wider than the interface moves in one deformation.
+         * The band is updated from the previous band (see update_band), so labels which are changed by set_label between deformations are only
+         * seen by the band after the next far field deformation, unless they are changed by set_labels.
          */
-        void deform(int num_steps = 10)
+        void set_narrow_band(int rings, int far_field_interval = 2)
         {
-#ifdef DEBUG
-            validity_check();
-#endif
-            std::cout << std::endl << "********************************" << std::endl;
-            int missing;
-            int step = 0;
-            do {
-                std::cout << "\nMove vertices step " << step << std::endl;
-                missing = 0;
-                int movable = 0;
-                for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
-                {
-                    if (is_movable(nit.key()))
-                    {
-                        if(!move_vertex(nit.key()))
-                        {
-                            missing++;
-                        }
-                        movable++;
-                    }
-                }
-                std::cout << "Vertices missing to be moved: " << missing <<"/" << movable << std::endl;
-                fix_complex();
-#ifdef DEBUG
-                validity_check();
-#endif
-                ++step;
-            } while (missing > 0 && step < num_steps);
-            
-            resize_complex();
-            
-            garbage_collect();
-            for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+            NARROW_BAND = rings;
+            FAR_FIELD_INTERVAL = far_field_interval;
+        }
+        
+        /**
+         * Returns the distance in rings from the node n to the interface if the node is in the narrow band of the current deformation and -1 otherwise.
+         */
+        int get_band_distance(const node_key& n) const
+        {
+            if (band_active && n < band_rings.size() && band_rings[n].first == band_generation)
             {
-                nit->set_destination(nit->get_pos());
+                return band_rings[n].second;
             }
-#ifdef DEBUG
-            validity_check();
-#endif
+            return -1;
         }
         
     private:
         
         /**
-         * Tries moving the node n to the new position new_pos. Returns true if it succeeds.
+         * Finds the nodes of the narrow band by a breadth first search from the interface nodes which stops after NARROW_BAND rings.
+         * The passes only change the interface next to it, that is the nodes on the interface are new nodes on interface edges or nodes of
+         * tetrahedra which are relabelled next to the interface. The interface is therefore only searched for among the nodes within one
+         * ring from the previous interface and their neighbours, and all nodes are only scanned if there is no previous band (the first
+         * deformation in narrow band mode and the first after a far field deformation). Thereby, the work is proportional to the size of the band.
          */
-        bool move_vertex(const node_key & n)
+        void update_band()
         {
-            vec3 pos = get_pos(n);
-            vec3 destination = get(n).get_destination();
-            real l = Util::length(destination - pos);
-            
-            if (l < 1e-4*AVG_LENGTH) // The vertex is not moved
+            std::vector<node_key> previous;
+            for (const node_key& n : band_nodes)
             {
-                return true;
+                if (band_rings[n].second <= 1)
+                {
+                    previous.push_back(n);
+                }
+            }
+            bool rescan = band_nodes.empty();
+            band_nodes.clear();
+            if (!band_active)
+            {
+                return;
             }
             
-            real max_l = l*intersection_with_link(n, destination) - 1e-4 * AVG_LENGTH;
-            l = Util::max(Util::min(0.5*max_l, l), 0.);
-            set_pos(n, pos + l*Util::normalize(destination - pos));
+            band_generation++;
+            auto visit = [&](const node_key& n, int ring) {
+                if (band_rings.size() <= n)
+                {
+                    band_rings.resize(std::max(static_cast<size_t>(n) + 1, 2*band_rings.size()), std::make_pair(0u, 0));
+                }
+                band_rings[n] = std::make_pair(band_generation, ring);
+                band_nodes.push_back(n);
+            };
+            auto seed = [&](const node_key& n) {
+                if (get(n).is_interface() && get_band_distance(n) < 0)
+                {
+                    visit(n, 0);
+                }
+            };
             
-            if (Util::length(destination - get_pos(n)) < 1e-4*AVG_LENGTH)
+            if (rescan)
             {
-                return true;
+                for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+                {
+                    seed(nit.key());
+                }
             }
-            return false;
-        }
-        
-        
-    public:
-        /**
-         * Returns the intersection point (= pos + t*(destination-pos)) with the link of the node n and
-         * when moving the node n to the new position destination.
-         */
-        real intersection_with_link(const node_key & n, const vec3& destination)
-        {
-            vec3 pos = get_pos(n);
-            vec3 ray = destination - pos;
-
-            real min_t = INFINITY;
-            auto fids = get_faces(get_tets(n)) - get_faces(n);
-            for(auto f : fids)
+            for (const node_key& n : previous)
             {
-                auto face_pos = get_pos(get_nodes(f));
-                real t = Util::intersection_ray_plane<real>(pos, ray, face_pos[0], face_pos[1], face_pos[2]);
-                if (0. <= t)
+                if (exists(n))
                 {
-                    min_t = Util::min(t, min_t);
+                    seed(n);
+                    for (const edge_key& e : get_edges(n))
+                    {
+                        for (const node_key& m : get_nodes(e))
+                        {
+                            seed(m);
+                        }
+                    }
                 }
             }
-#ifdef DEBUG
-            assert(min_t < INFINITY);
-#endif
-            return min_t;
-        }
-        
-        ///////////
-        // FLIPS //
-        ///////////
-    private:
-        
-        /**
-         * Returns whether the interface or boundary faces in fids are flat.
-         */
-        bool is_flat(const is_mesh::SimplexSet<face_key>& fids)
-        {
-            for (const face_key& f1 : fids) {
-                if (get(f1).is_interface() || get(f1).is_boundary())
+            for (unsigned int i = 0; i < band_nodes.size(); i++)
+            {
+                node_key n = band_nodes[i];
+                int ring = band_rings[n].second;
+                if (ring < NARROW_BAND)
                 {
-                    vec3 normal1 = get_normal(f1);
-                    for (const face_key& f2 : fids) {
-                        if (f1 != f2 && (get(f2).is_interface() || get(f2).is_boundary()))
+                    for (const edge_key& e : get_edges(n))
+                    {
+                        for (const node_key& m : get_nodes(e))
                         {
-                            vec3 normal2 = get_normal(f2);
-                            if(std::abs(dot(normal1, normal2)) < FLIP_EDGE_INTERFACE_FLATNESS)
+                            if (get_band_distance(m) < 0)
                             {
-                                return false;
+                                visit(m, ring + 1);
                             }
                         }
                     }
                 }
             }
-            return true;
         }
         
         /**
-         * Returns whether it is possible to flip the edge e or not, i.e. whether the edge is a feature edge
-         * (it is not a feature edge if its neighborhood is sufficiently flat).
+         * Calls the function f with each node in the narrow band or with all nodes if the narrow band is not active.
+         */
+        template<typename Function>
+        void for_each_band_node(Function f)
+        {
+            if (band_active)
+            {
+                for (unsigned int i = 0; i < band_nodes.size(); i++)
+                {
+                    if (exists(band_nodes[i]))
+                    {
+                        f(band_nodes[i]);
+                    }
+                }
+            }
+            else {
+                for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+                {
+                    f(nit.key());
+                }
+            }
+        }
+        
+        /**
+         * Returns the simplices which have a node in the narrow band, or all simplices if the narrow band is not active, in increasing order of their keys.
+         * The function add_simplices passes each simplex incident to a node to add_band_simplex.
+         */
+        template<typename key_type, typename Iterator, typename Function>
+        std::vector<key_type> get_band_simplices(Iterator begin, Iterator end, Function add_simplices)
+        {
+            std::vector<key_type> keys;
+            if (band_active)
+            {
+                band_stamp++;
+                for_each_band_node([&](const node_key& n) {
+                    add_simplices(n, keys);
+                });
+                std::sort(keys.begin(), keys.end());
+            }
+            else {
+                for (auto it = begin; it != end; it++)
+                {
+                    keys.push_back(it.key());
+                }
+            }
+            return keys;
+        }
+        
+        /**
+         * Adds the simplex k to keys unless it is already added. A simplex is reached from several nodes, so the added simplices are stamped instead of
+         * merged with SimplexSet unions.
+         */
+        template<typename key_type>
+        void add_band_simplex(const key_type& k, std::vector<key_type>& keys)
+        {
+            if (band_stamps.size() <= k)
+            {
+                band_stamps.resize(std::max(static_cast<size_t>(k) + 1, 2*band_stamps.size()), 0u);
+            }
+            if (band_stamps[k] != band_stamp)
+            {
+                band_stamps[k] = band_stamp;
+                keys.push_back(k);
+            }
+        }
+        
+        std::vector<edge_key> get_band_edges()
+        {
+            return get_band_simplices<edge_key>(edges_begin(), edges_end(), [&](const node_key& n, std::vector<edge_key>& keys) {
+                for (const edge_key& e : get_edges(n))
+                {
+                    add_band_simplex(e, keys);
+                }
+            });
+        }
+        
+        std::vector<face_key> get_band_faces()
+        {
+            return get_band_simplices<face_key>(faces_begin(), faces_end(), [&](const node_key& n, std::vector<face_key>& keys) {
+                for (const edge_key& e : get_edges(n))
+                {
+                    for (const face_key& f : get_faces(e))
+                    {
+                        add_band_simplex(f, keys);
+                    }
+                }
+            });
+        }
+        
+        std::vector<tet_key> get_band_tets()
+        {
+            return get_band_simplices<tet_key>(tetrahedra_begin(), tetrahedra_end(), [&](const node_key& n, std::vector<tet_key>& keys) {
+                for (const edge_key& e : get_edges(n))
+                {
+                    for (const face_key& f : get_faces(e))
+                    {
+                        for (const tet_key& t : get_tets(f))
+                        {
+                            add_band_simplex(t, keys);
+                        }
+                    }
+                }
+            });
+        }
+        
+        ////////////////////
+        // MOVE FUNCTIONS //
+        ////////////////////
+    public:
+        /**
+         * Moves all the vertices to their destination which can be set by the set_destination() function.
+         */
+        void deform(int num_steps = 10)
+        {
+            start_deform(num_steps);
+            resume_deform();
+        }
+        
+        /**
+         * Starts moving all the vertices to their destination like deform. The work is done by resume_deform, which can be called repeatedly with a budget,
+         * such that the caller can interleave other work with the deformation. The mesh must not be changed by others before the deformation is finished.
+         */
+        void start_deform(int num_steps = 10)
+        {
+#ifdef DEBUG
+            validity_check();
+#endif
+            if (verbose)
+            {
+                std::cout << std::endl << "********************************" << std::endl;
+            }
+            deform_num_steps = num_steps;
+            deform_step = 0;
+            deform_missing = 0;
+            deform_operations = 0;
+            deform_resized = false;
+            deform_operation = MOVE_VERTICES;
+            band_active = NARROW_BAND >= 0 && (FAR_FIELD_INTERVAL <= 0 || deform_count % FAR_FIELD_INTERVAL != 0);
+            deform_count++;
+        }
+        
+        /**
+         * Continues the deformation started by start_deform until it is finished, time_budget seconds are spent or max_operations operations are performed.
+         * An operation is one pass of deform, for example moving the vertices or smoothing, and it is never interrupted. Therefore, at least one operation
+         * is performed and the time budget is exceeded by at most the duration of one operation. Returns whether the deformation is finished.
+         */
+        bool resume_deform(real time_budget = INFINITY, int max_operations = std::numeric_limits<int>::max())
+        {
+            auto start_time = std::chrono::steady_clock::now();
+            for (int i = 0; i < max_operations && deform_operation != IDLE; i++)
+            {
+                std::chrono::duration<real> t = std::chrono::steady_clock::now() - start_time;
+                if (i > 0 && t.count() >= time_budget)
+                {
+                    break;
+                }
+                perform_deform_operation();
+            }
+            return deform_operation == IDLE;
+        }
+        
+        /**
+         * Returns whether a deformation is started and not yet finished.
+         */
+        bool is_deforming() const
+        {
+            return deform_operation != IDLE;
+        }
+        
+        /**
+         * Returns the fraction of the operations of the current deformation which are performed. It is assumed that all the move steps are needed,
+         * so the progress jumps ahead when the vertices reach their destination in fewer steps.
+         */
+        real get_deform_progress() const
+        {
+            const int FIX_OPERATIONS = REMOVE_DEGENERATE_EDGES - SMOOTH + 1;
+            const int MOVE_STEP_OPERATIONS = FIX_OPERATIONS + 1;
+            const int RESIZE_OPERATIONS = THINNING - THICKENING_INTERFACE + 1 + FIX_OPERATIONS + 1;
+            
+            int remaining = 0;
+            if (deform_operation == IDLE)
+            {
+                return 1.;
+            }
+            else if (deform_operation == FINISH)
+            {
+                remaining = 1;
+            }
+            else if (deform_operation >= THICKENING_INTERFACE)
+            {
+                remaining = RESIZE_OPERATIONS - (deform_operation - THICKENING_INTERFACE);
+            }
+            else if (deform_resized)
+            {
+                remaining = REMOVE_DEGENERATE_EDGES - deform_operation + 2;
+            }
+            else {
+                remaining = (deform_num_steps - deform_step) * MOVE_STEP_OPERATIONS - (deform_operation - MOVE_VERTICES) + RESIZE_OPERATIONS;
+            }
+            return static_cast<real>(deform_operations) / static_cast<real>(deform_operations + remaining);
+        }
+        
+    private:
+        
+        /**
+         * Performs the next operation of the current deformation and advances to the following operation.
+         */
+        void perform_deform_operation()
+        {
+            if (deform_operation == IDLE)
+            {
+                return;
+            }
+            Util::Trace::Scope trace(get_operation_name(deform_operation));
+#ifdef DSC_METRICS
+            ScopedTimer timer(metrics[deform_operation]);
+#endif
+            switch (deform_operation) {
+                case MOVE_VERTICES:
+                    update_band();
+                    move_vertices();
+                    break;
+                case SMOOTH:
+                    smooth();
+                    break;
+                case TOPOLOGICAL_EDGE_REMOVAL:
+                    topological_edge_removal();
+                    break;
+                case TOPOLOGICAL_FACE_REMOVAL:
+                    topological_face_removal();
+                    break;
+                case REMOVE_DEGENERATE_TETS:
+                    remove_degenerate_tets();
+                    break;
+                case REMOVE_DEGENERATE_FACES:
+                    remove_degenerate_faces();
+                    break;
+                case REMOVE_DEGENERATE_EDGES:
+                    remove_degenerate_edges();
+                    break;
+                case THICKENING_INTERFACE:
+                    thickening_interface();
+                    break;
+                case THINNING_INTERFACE:
+                    thinning_interface();
+                    break;
+                case THICKENING:
+                    thickening();
+                    break;
+                case THINNING:
+                    thinning();
+                    break;
+                case FINISH:
+                    garbage_collect();
+                    for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+                    {
+                        get_mutable(nit.key()).set_destination(nit->get_pos());
+                    }
+#ifdef DEBUG
+                    validity_check();
+#endif
+                    break;
+                case IDLE:
+                    return;
+            }
+            deform_operations++;
+            
+            if (deform_operation == REMOVE_DEGENERATE_EDGES)
+            {
+                if (deform_resized)
+                {
+                    deform_operation = FINISH;
+                }
+                else {
+#ifdef DEBUG
+                    validity_check();
+#endif
+                    ++deform_step;
+                    deform_operation = deform_missing > 0 && deform_step < deform_num_steps ? MOVE_VERTICES : THICKENING_INTERFACE;
+                }
+            }
+            else if (deform_operation == THINNING)
+            {
+                update_band();
+                deform_resized = true;
+                deform_operation = SMOOTH;
+            }
+            else {
+                deform_operation = static_cast<DeformOperation>(deform_operation + 1);
+            }
+        }
+        
+        /**
+         * Adds the counts of one pass of the given operation to its metrics (see OperationMetrics). Does nothing unless DSC_METRICS is defined.
+         */
+#ifdef DSC_METRICS
+        void record(DeformOperation operation, int candidates, int attempts, int successes, int fallbacks = 0)
+        {
+            metrics[operation].record(candidates, attempts, successes, fallbacks);
+        }
+#else
+        void record(DeformOperation, int, int, int, int = 0)
+        {
+            
+        }
+#endif
+        
+        /**
+         * Moves each movable vertex as far towards its destination as possible and counts the vertices which did not reach their destination.
+         */
+        void move_vertices()
+        {
+            if (verbose)
+            {
+                std::cout << "\nMove vertices step " << deform_step << std::endl;
+            }
+            deform_missing = 0;
+            int movable = 0;
+            for (auto nit = nodes_begin(); nit != nodes_end(); nit++)
+            {
+                if (is_movable(nit.key()))
+                {
+                    if(!move_vertex(nit.key()))
+                    {
+                        deform_missing++;
+                    }
+                    movable++;
+                }
+            }
+            record(MOVE_VERTICES, movable, movable, movable - deform_missing);
+            if (verbose)
+            {
+                std::cout << "Vertices missing to be moved: " << deform_missing <<"/" << movable << std::endl;
+            }
+        }
+        
+        /**
+         * Tries moving the node n to the new position new_pos. Returns true if it succeeds.
+         */
+        bool move_vertex(const node_key & n)
+        {
+            vec3 pos = get_pos(n);
+            vec3 destination = get(n).get_destination();
+            real l = Util::length(destination - pos);
+            
+            if (l < 1e-4*AVG_LENGTH) // The vertex is not moved
+            {
+                return true;
+            }
+            
+            real max_l = l*intersection_with_link(n, destination) - 1e-4 * AVG_LENGTH;
+            l = Util::max(Util::min(0.5*max_l, l), 0.);
+            set_pos(n, pos + l*Util::normalize(destination - pos));
+            
+            if (Util::length(destination - get_pos(n)) < 1e-4*AVG_LENGTH)
+            {
+                return true;
+            }
+            return false;
+        }
+        
+        
+    public:
+        /**
+         * Returns the intersection point (= pos + t*(destination-pos)) with the link of the node n and
+         * when moving the node n to the new position destination.
+         * The parameter t of the plane of a link face is V(pos)/(V(pos) - V(destination)) where V(p) is the signed volume of the face and p.
+         * The volume is linear in p and is evaluated with the exact orientation predicate, so t is only negative when the node moves away from the face.
+         */
+        real intersection_with_link(const node_key & n, const vec3& destination)
+        {
+            vec3 pos = get_pos(n);
+
+            real min_t = INFINITY;
+            auto fids = get_faces(get_tets(n)) - get_faces(n);
+            for(auto f : fids)
+            {
+                auto face_pos = get_pos(get_nodes(f));
+                double v_pos = Util::orient3d(face_pos[0], face_pos[1], face_pos[2], pos);
+                double v_dest = Util::orient3d(face_pos[0], face_pos[1], face_pos[2], destination);
+                if (v_pos == v_dest) // The node moves parallel to the face or is in the plane of the face.
+                {
+                    if (v_pos == 0.)
+                    {
+                        min_t = 0.;
+                    }
+                    continue;
+                }
+                real t = static_cast<real>(v_pos / (v_pos - v_dest));
+                if (0. <= t)
+                {
+                    min_t = Util::min(t, min_t);
+                }
+            }
+#ifdef DEBUG
+            assert(min_t < INFINITY);
+#endif
+            return min_t;
+        }
+        
+        ///////////
+        // FLIPS //
+        ///////////
+    private:
+        
+        /**
+         * Returns whether the interface or boundary faces in fids are flat.
+         */
+        bool is_flat(const is_mesh::SimplexSet<face_key>& fids)
+        {
+            for (const face_key& f1 : fids) {
+                if (get(f1).is_interface() || get(f1).is_boundary())
+                {
+                    vec3 normal1 = get_normal(f1);
+                    for (const face_key& f2 : fids) {
+                        if (f1 != f2 && (get(f2).is_interface() || get(f2).is_boundary()))
+                        {
+                            vec3 normal2 = get_normal(f2);
+                            if(std::abs(dot(normal1, normal2)) < FLIP_EDGE_INTERFACE_FLATNESS)
+                            {
+                                return false;
+                            }
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+        
+        /**
+         * Returns whether it is possible to flip the edge e or not, i.e. whether the edge is a feature edge
+         * (it is not a feature edge if its neighborhood is sufficiently flat).
          */
         bool is_flippable(const edge_key & eid)
         {
@@ -1579,21 +2282,22 @@ namespace DSC {
                 return false;
             }
             
-            vec3 p = get_pos(new_e_nids[0]);
-            vec3 r = get_pos(new_e_nids[1]) - p;
-            vec3 a = get_pos(e_nids[0]);
-            vec3 b = get_pos(e_nids[1]);
+            // The edge can be flipped if the new edge |pq| intersects a triangle |abc| where c is an apex. The test uses the exact orientation predicate:
+            // p and q must be on opposite sides of the plane of the triangle and the signed volumes of |pqbc|, |pqca| and |pqab|, which are proportional
+            // to the barycentric coordinates of the intersection point, must have the same sign (the intersection may be on the edge |ab|).
+            const vec3& p = get_pos(new_e_nids[0]);
+            const vec3& q = get_pos(new_e_nids[1]);
+            const vec3& a = get_pos(e_nids[0]);
+            const vec3& b = get_pos(e_nids[1]);
+            int s_ab = Util::sign(Util::orient3d(p, q, a, b));
             
             for (node_key n : apices) {
-                vec3 c = get_pos(n);
-                real t = Util::intersection_ray_plane<real>(p, r, a, b, c);
-                if(t > 0. && t < 1.)
-                {
-                    std::vector<real> coords = Util::barycentric_coords<real>(p + t*r, c, a, b);
-                    if(coords[0] > EPSILON && coords[1] > EPSILON && coords[2] >= 0.)
-                    {
-                        return true;
-                    }
+                const vec3& c = get_pos(n);
+                int s_bc = Util::sign(Util::orient3d(p, q, b, c));
+                if(s_bc != 0 && Util::sign(Util::orient3d(p, q, c, a)) == s_bc && s_ab != -s_bc
+                   && Util::sign(Util::orient3d(a, b, c, p)) * Util::sign(Util::orient3d(a, b, c, q)) < 0)
+                {
+                    return true;
                 }
             }
             
@@ -1641,6 +2345,184 @@ namespace DSC {
             split(eid, pos, destination);
         }
         
+        /**
+         * Refines the tetrahedra tids regularly into eight tetrahedra each (red refinement) by splitting all their edges at the middle.
+         * The neighbouring tetrahedra are refined such that the mesh stays conforming: A tetrahedron with one split edge is split into two
+         * and a tetrahedron with three split edges on one face into four (green refinement). Any other tetrahedron is refined regularly as well.
+         * All tetrahedra are replaced in a single pass, and the labels and thereby the interface are preserved.
+         */
+        void refine(const std::vector<tet_key>& tids)
+        {
+            // Find the edges which are split
+            std::map<edge_key, int> midpoints;
+            std::set<tet_key> red;
+            std::vector<edge_key> queue;
+            auto refine_red = [&](const tet_key& t) {
+                if (red.insert(t).second)
+                {
+                    for (auto e : get_edges(t))
+                    {
+                        if (midpoints.insert(std::make_pair(e, -1)).second)
+                        {
+                            queue.push_back(e);
+                        }
+                    }
+                }
+            };
+            auto split_edges = [&](const tet_key& t) {
+                is_mesh::SimplexSet<edge_key> eids;
+                for (auto e : get_edges(t))
+                {
+                    if (midpoints.find(e) != midpoints.end())
+                    {
+                        eids += e;
+                    }
+                }
+                return eids;
+            };
+            for (auto t : tids)
+            {
+                refine_red(t);
+            }
+            while (!queue.empty())
+            {
+                edge_key e = queue.back();
+                queue.pop_back();
+                for (auto t : get_tets(e))
+                {
+                    if (red.find(t) == red.end())
+                    {
+                        is_mesh::SimplexSet<edge_key> eids = split_edges(t);
+                        if (eids.size() != 1 && !(eids.size() == 3 && get_nodes(eids).size() == 3))
+                        {
+                            refine_red(t);
+                        }
+                    }
+                }
+            }
+            
+            // Create the nodes at the middle of the split edges
+            std::vector<node_key> nids;
+            std::map<node_key, int> indices;
+            auto index = [&](const node_key& n) {
+                auto it = indices.insert(std::make_pair(n, static_cast<int>(nids.size())));
+                if (it.second)
+                {
+                    nids.push_back(n);
+                }
+                return it.first->second;
+            };
+            std::set<tet_key> old_tids;
+            std::vector<std::array<node_key, 3>> splits;
+            for (auto& m : midpoints)
+            {
+                const is_mesh::SimplexSet<node_key>& e_nids = get_nodes(m.first);
+                vec3 pos = Util::barycenter(get_pos(e_nids[0]), get_pos(e_nids[1]));
+                vec3 destination = pos;
+                if (get(m.first).is_interface())
+                {
+                    destination = Util::barycenter(get(e_nids[0]).get_destination(), get(e_nids[1]).get_destination());
+                }
+                node_key n = this->insert_node(pos);
+                get_mutable(n).set_destination(destination);
+                m.second = index(n);
+                splits.push_back({{n, e_nids[0], e_nids[1]}});
+                for (auto t : get_tets(m.first))
+                {
+                    old_tids.insert(t);
+                }
+            }
+            
+            // Create the new tetrahedra
+            std::vector<int> tets;
+            std::vector<int> labels;
+            auto add_tet = [&](int a, int b, int c, int d, int label) {
+                tets.insert(tets.end(), {a, b, c, d});
+                labels.push_back(label);
+            };
+            for (auto t : old_tids)
+            {
+                int label = get_label(t);
+                if (red.find(t) != red.end())
+                {
+                    // The corners and the middle of the edge between corner i and j
+                    is_mesh::SimplexSet<node_key> t_nids = get_nodes(t);
+                    int c[4], m[4][4];
+                    for (int i = 0; i < 4; i++)
+                    {
+                        c[i] = index(t_nids[i]);
+                        for (int j = i + 1; j < 4; j++)
+                        {
+                            m[i][j] = m[j][i] = midpoints[get_edge(t_nids[i], t_nids[j])];
+                        }
+                    }
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int j = (i + 1) % 4, k = (i + 2) % 4, l = (i + 3) % 4;
+                        add_tet(c[i], m[i][j], m[i][k], m[i][l], label);
+                    }
+                    
+                    // Split the inner octahedron along its shortest diagonal
+                    int pairs[3][4] = {{0, 1, 2, 3}, {0, 2, 1, 3}, {0, 3, 1, 2}};
+                    int best = 0;
+                    real min_length = INFINITY;
+                    for (int p = 0; p < 3; p++)
+                    {
+                        real l = Util::length(get_pos(nids[m[pairs[p][0]][pairs[p][1]]]) - get_pos(nids[m[pairs[p][2]][pairs[p][3]]]));
+                        if (l < min_length)
+                        {
+                            min_length = l;
+                            best = p;
+                        }
+                    }
+                    int a = m[pairs[best][0]][pairs[best][1]], b = m[pairs[best][2]][pairs[best][3]];
+                    const int* x = pairs[(best + 1) % 3];
+                    const int* y = pairs[(best + 2) % 3];
+                    int cycle[4] = {m[x[0]][x[1]], m[y[0]][y[1]], m[x[2]][x[3]], m[y[2]][y[3]]};
+                    for (int i = 0; i < 4; i++)
+                    {
+                        add_tet(a, b, cycle[i], cycle[(i + 1) % 4], label);
+                    }
+                }
+                else {
+                    is_mesh::SimplexSet<edge_key> eids = split_edges(t);
+                    if (eids.size() == 1)
+                    {
+                        const is_mesh::SimplexSet<node_key>& e_nids = get_nodes(eids[0]);
+                        is_mesh::SimplexSet<node_key> apices = get_nodes(t) - e_nids;
+                        int m = midpoints[eids[0]], c = index(apices[0]), d = index(apices[1]);
+                        add_tet(index(e_nids[0]), m, c, d, label);
+                        add_tet(m, index(e_nids[1]), c, d, label);
+                    }
+                    else {
+                        is_mesh::SimplexSet<node_key> f_nids = get_nodes(eids);
+                        int d = index((get_nodes(t) - f_nids).front());
+                        int c[3], m[3];
+                        for (int i = 0; i < 3; i++)
+                        {
+                            c[i] = index(f_nids[i]);
+                            m[i] = midpoints[get_edge(f_nids[i], f_nids[(i + 1) % 3])];
+                        }
+                        for (int i = 0; i < 3; i++)
+                        {
+                            add_tet(c[i], m[i], m[(i + 2) % 3], d, label);
+                        }
+                        add_tet(m[0], m[1], m[2], d, label);
+                    }
+                }
+            }
+            
+            replace(old_tids, nids, tets, labels);
+            for (auto& n : splits)
+            {
+                this->update_split(n[0], n[1], n[2]);
+            }
+            if (verbose)
+            {
+                std::cout << "Refined " << red.size() << " tetrahedra (" << old_tids.size() - red.size() << " by closure)" << std::endl;
+            }
+        }
+        
         ///////////////
         // COLLAPSES //
         ///////////////
@@ -1751,6 +2633,139 @@ namespace DSC {
             return collapse(eids, safe);
         }
         
+        //////////////////////
+        // CAVITY REMESHING //
+        //////////////////////
+        
+        /**
+         * Re-tetrahedralizes the cavity of the tetrahedra which share a node with tid and have the same label as tid by the cavity tetralizer
+         * (see set_cavity_tetralizer). The boundary of the cavity, and thereby the interface, is preserved while the nodes inside the cavity are
+         * replaced. The cavity is only replaced if the result is a valid tetralization of the cavity which improves the minimum quality.
+         */
+        bool remesh_cavity(const tet_key& tid)
+        {
+            if (!cavity_tetralizer)
+            {
+                return false;
+            }
+            
+            // Find the cavity
+            int label = get_label(tid);
+            is_mesh::SimplexSet<tet_key> cavity;
+            for (auto t : get_tets(get_nodes(tid)))
+            {
+                if (get_label(t) == label)
+                {
+                    if (!is_unsafe_editable(t))
+                    {
+                        return false;
+                    }
+                    cavity += t;
+                }
+            }
+            
+            // Find its boundary
+            std::map<node_key, int> indices;
+            std::vector<node_key> nids;
+            std::vector<vec3> points;
+            std::vector<int> faces;
+            for (auto f : get_faces(cavity))
+            {
+                if ((get_tets(f) - cavity).size() > 0 || get_tets(f).size() == 1)
+                {
+                    for (auto n : get_nodes(f))
+                    {
+                        auto it = indices.insert(std::make_pair(n, static_cast<int>(nids.size())));
+                        if (it.second)
+                        {
+                            nids.push_back(n);
+                            points.push_back(get_pos(n));
+                        }
+                        faces.push_back(it.first->second);
+                    }
+                }
+            }
+            for (auto n : get_nodes(cavity))
+            {
+                if (indices.find(n) == indices.end() && !is_safe_editable(n))
+                {
+                    return false;
+                }
+            }
+            
+            std::vector<int> tets;
+            if (!cavity_tetralizer(points, faces, tets) || !is_cavity_tetralization(points, faces, tets, cavity))
+            {
+                return false;
+            }
+            
+            // Replace the cavity
+            for (unsigned int i = static_cast<unsigned int>(nids.size()); i < points.size(); i++)
+            {
+                node_key n = this->insert_node(points[i]);
+                get_mutable(n).set_destination(points[i]);
+                nids.push_back(n);
+            }
+            replace(cavity, nids, tets);
+            return true;
+        }
+        
+        /**
+         * Returns whether the tetrahedra tets are a tetralization of the cavity with the boundary faces which improves the minimum quality of the
+         * tetrahedra in the cavity. Each boundary face must be a face of exactly one new tetrahedron, every other face of exactly two, and
+         * the new tetrahedra must have the volume of the cavity.
+         */
+        bool is_cavity_tetralization(const std::vector<vec3>& points, const std::vector<int>& faces, const std::vector<int>& tets, const is_mesh::SimplexSet<tet_key>& cavity)
+        {
+            if (tets.empty() || tets.size() % 4 != 0)
+            {
+                return false;
+            }
+            for (int i : tets)
+            {
+                if (i < 0 || i >= static_cast<int>(points.size()))
+                {
+                    return false;
+                }
+            }
+            
+            auto face = [](int a, int b, int c) {
+                std::array<int, 3> f = {{a, b, c}};
+                std::sort(f.begin(), f.end());
+                return f;
+            };
+            std::map<std::array<int, 3>, int> count;
+            for (unsigned int i = 0; i < faces.size(); i += 3)
+            {
+                count[face(faces[i], faces[i+1], faces[i+2])] = 1;
+            }
+            real q_min = INFINITY, vol = 0.;
+            for (unsigned int i = 0; i < tets.size(); i += 4)
+            {
+                const vec3 &a = points[tets[i]], &b = points[tets[i+1]], &c = points[tets[i+2]], &d = points[tets[i+3]];
+                q_min = Util::min(q_min, std::abs(Util::quality<real>(a, b, c, d)));
+                vol += Util::volume<real>(a, b, c, d);
+                for (int j = 0; j < 4; j++)
+                {
+                    count[face(tets[i + (j+1)%4], tets[i + (j+2)%4], tets[i + (j+3)%4])]--;
+                }
+            }
+            for (auto& c : count)
+            {
+                if (c.second != 0 && c.second != -2)
+                {
+                    return false;
+                }
+            }
+            
+            real cavity_vol = 0.;
+            for (auto t : cavity)
+            {
+                cavity_vol += volume(t);
+            }
+            return std::abs(vol - cavity_vol) <= 1e-6 * cavity_vol && q_min > min_quality(cavity);
+        }
+        
         //////////////////////
         // GETTER FUNCTIONS //
         //////////////////////
@@ -1913,7 +2928,34 @@ namespace DSC {
         
         real quality(const edge_key& eid)
         {
-            return length(eid)/AVG_LENGTH;
+            return length(eid)/target_length(eid);
+        }
+        
+        /**
+         * Returns the target edge length at the midpoint of the edge eid.
+         */
+        real target_length(const edge_key& eid)
+        {
+            if (!sizing_field)
+            {
+                return AVG_LENGTH;
+            }
+            const is_mesh::SimplexSet<node_key>& nids = get_nodes(eid);
+            return sizing_field(Util::barycenter(get_pos(nids[0]), get_pos(nids[1])));
+        }
+        
+        /**
+         * Returns the volume of a regular tetrahedron with the target edge length at the barycenter of the tetrahedron tid.
+         */
+        real target_volume(const tet_key& tid)
+        {
+            if (!sizing_field)
+            {
+                return AVG_VOLUME;
+            }
+            is_mesh::SimplexSet<node_key> nids = get_nodes(tid);
+            real l = sizing_field(Util::barycenter(get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]), get_pos(nids[3])));
+            return l*l*l*sqrt(2.)/12.;
         }
         
         /**
@@ -2041,9 +3083,95 @@ namespace DSC {
             }
         }
         
+        /**
+         * Calls the function f with each tetrahedron and its quality. The qualities are evaluated in batches by Util::qualities.
+         * If in_band is true, only the tetrahedra in the narrow band are visited (see set_narrow_band).
+         */
+        template<typename Function>
+        void for_each_quality(Function f, bool in_band = false)
+        {
+            for_each_batch([&](const Util::TetrahedronBatch<real>& batch, const tet_key* tids, unsigned int n) {
+                real q[Util::BATCH_SIZE];
+                Util::qualities(batch, q);
+                for (unsigned int k = 0; k < n; ++k)
+                {
+                    f(tids[k], std::abs(q[k]));
+                }
+            }, in_band);
+        }
+        
+        /**
+         * Calls the function f with each tetrahedron and the cosines to its dihedral angles (see cos_dihedral_angles). The angles are evaluated in batches by Util::cos_dihedral_angles.
+         */
+        template<typename Function>
+        void for_each_cos_dihedral_angles(Function f)
+        {
+            for_each_batch([&](const Util::TetrahedronBatch<real>& batch, const tet_key* tids, unsigned int n) {
+                real cos_angles[6][Util::BATCH_SIZE];
+                Util::cos_dihedral_angles(batch, cos_angles);
+                std::array<real, 6> angles;
+                for (unsigned int k = 0; k < n; ++k)
+                {
+                    for (unsigned int e = 0; e < 6; ++e)
+                    {
+                        angles[e] = cos_angles[e][k];
+                    }
+                    f(tids[k], angles);
+                }
+            });
+        }
         
     private:
         
+        /**
+         * Calls the function f with each tetrahedron in the narrow band and its quality.
+         */
+        template<typename Function>
+        void for_each_band_quality(Function f)
+        {
+            for_each_quality(f, true);
+        }
+        
+        /**
+         * Gathers the vertex positions of all tetrahedra, or the tetrahedra in the narrow band if in_band is true, into batches of Util::BATCH_SIZE tetrahedra
+         * and calls the kernel with each batch, the keys of the tetrahedra in the batch and the number of tetrahedra in the batch.
+         */
+        template<typename Kernel>
+        void for_each_batch(Kernel kernel, bool in_band = false)
+        {
+            Util::TetrahedronBatch<real> batch;
+            tet_key tids[Util::BATCH_SIZE];
+            unsigned int n = 0;
+            auto add = [&](const tet_key& t) {
+                is_mesh::SimplexSet<node_key> nids = get_nodes(t);
+                batch.set(n, get_pos(nids[0]), get_pos(nids[1]), get_pos(nids[2]), get_pos(nids[3]));
+                tids[n++] = t;
+                if (n == Util::BATCH_SIZE)
+                {
+                    kernel(batch, tids, n);
+                    n = 0;
+                }
+            };
+            if (in_band && band_active)
+            {
+                for (auto t : get_band_tets())
+                {
+                    add(t);
+                }
+            }
+            else {
+                for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+                {
+                    add(tit.key());
+                }
+            }
+            if (n > 0)
+            {
+                batch.pad(n);
+                kernel(batch, tids, n);
+            }
+        }
+        
         /**
          * Check if the sequence of vertices in polygon is consistent with positive orientation of tetrahedra in the mesh
          * with respect to the ordered pair of vertices in vv. If not, reverse the order of vertices in polygon.
@@ -2093,10 +3221,11 @@ namespace DSC {
             return acos(cos_dihedral_angle(f1, f2));
         }
         
-        std::vector<real> cos_dihedral_angles(const tet_key& tid)
+        std::array<real, 6> cos_dihedral_angles(const tet_key& tid)
         {
             auto verts = get_pos(get_nodes(tid));
-            std::vector<real> angles;
+            std::array<real, 6> angles;
+            unsigned int e = 0;
             std::vector<int> apices;
             for (unsigned int i = 0; i < verts.size(); i++) {
                 for (unsigned int j = 0; j < verts.size(); j++) {
@@ -2109,7 +3238,7 @@ namespace DSC {
                                 apices.push_back(k);   
                             }
                         }
-                        angles.push_back(Util::cos_dihedral_angle<real>(verts[i], verts[j], verts[apices[0]], verts[apices[1]]));
+                        angles[e++] = Util::cos_dihedral_angle<real>(verts[i], verts[j], verts[apices[0]], verts[apices[1]]);
                     }
                 }
             }
@@ -2122,7 +3251,7 @@ namespace DSC {
         real min_cos_dihedral_angle(const tet_key& t)
         {
             real min_angle = -1.;
-            std::vector<real> angles = cos_dihedral_angles(t);
+            std::array<real, 6> angles = cos_dihedral_angles(t);
             for(auto a : angles)
             {
                 min_angle = Util::max(min_angle, a);
@@ -2148,16 +3277,14 @@ namespace DSC {
                 histogram[i] = 0;
             }
             
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                real q = quality(tit.key());
+            for_each_quality([&](const tet_key&, real q) {
                 min_quality = Util::min(min_quality, q);
                 int index = static_cast<int>(floor(q*100.));
 #ifdef DEBUG
                 assert(index < 100 && index >= 0);
 #endif
                 histogram[index] += 1;
-            }
+            });
         }
         
         /**
@@ -2174,9 +3301,7 @@ namespace DSC {
                 histogram[i] = 0;
             }
             
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                std::vector<real> angles = cos_dihedral_angles(tit.key());
+            for_each_cos_dihedral_angles([&](const tet_key&, const std::array<real, 6>& angles) {
                 for(auto cos_a : angles)
                 {
                     real a = acos(cos_a)*180./M_PI;
@@ -2184,16 +3309,15 @@ namespace DSC {
                     max_angle = Util::max(max_angle, a);
                     histogram[(int)floor(a)] += 1;
                 }
-            }
+            });
         }
         
         real min_quality()
         {
             real min_q = INFINITY;
-            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
-            {
-                min_q = Util::min(min_q, quality(tit.key()));
-            }
+            for_each_quality([&](const tet_key&, real q) {
+                min_q = Util::min(min_q, q);
+            });
             return min_q;
         }
         
@@ -2253,6 +3377,21 @@ namespace DSC {
             }
         }
         
+        /// Sums the volume of all tetrahedra and of the tetrahedra in the object(s).
+        void sum_volumes(real & total, real & object)
+        {
+            total = 0., object = 0.;
+            for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+            {
+                real v = volume(tit.key());
+                total += v;
+                if (tit->label() != 0)
+                {
+                    object += v;
+                }
+            }
+        }
+        
     public:
         void test_split_collapse()
         {
@@ -2502,6 +3641,134 @@ namespace DSC {
             }
         }
         
+        void test_refine()
+        {
+            real total, object;
+            sum_volumes(total, object);
+            real tolerance = std::sqrt(std::numeric_limits<real>::epsilon());
+            
+            // A contiguous region around the first tetrahedron and then a scattered set of tetrahedra
+            for (int test = 0; test < 2; test++)
+            {
+                std::vector<tet_key> tids;
+                if (test == 0)
+                {
+                    is_mesh::SimplexSet<tet_key> region;
+                    region += tetrahedra_begin().key();
+                    for (size_t size = 0; region.size() < 100 && region.size() > size; )
+                    {
+                        size = region.size();
+                        region = get_tets(get_nodes(region));
+                    }
+                    tids.assign(region.begin(), region.end());
+                }
+                else {
+                    int i = 0;
+                    for (auto tit = tetrahedra_begin(); tit != tetrahedra_end(); tit++)
+                    {
+                        if (i++ % 200 == 0)
+                        {
+                            tids.push_back(tit.key());
+                        }
+                    }
+                }
+                
+                std::cout << "Refine test # = " << tids.size();
+                bool was_verbose = verbose;
+                verbose = false;
+                refine(tids);
+                verbose = was_verbose;
+                garbage_collect();
+                
+                real new_total, new_object;
+                sum_volumes(new_total, new_object);
+                assert(std::abs(new_total - total) <= tolerance*total);
+                assert(std::abs(new_object - object) <= tolerance*object);
+                std::cout << " DONE" << std::endl;
+                validity_check();
+            }
+        }
+        
+        void test_remesh_cavity()
+        {
+            if (!cavity_tetralizer)
+            {
+                std::cout << "Cavity remeshing test skipped, since there is no cavity tetralizer (see set_cavity_tetralizer)." << std::endl;
+                return;
+            }
+            real total, object;
+            sum_volumes(total, object);
+            real tolerance = std::sqrt(std::numeric_limits<real>::epsilon());
+            
+            // The tetrahedra with the lowest quality
+            std::vector<std::pair<real, tet_key>> qualities;
+            for_each_quality([&](const tet_key& t, real q) {
+                qualities.push_back(std::make_pair(q, t));
+            });
+            std::sort(qualities.begin(), qualities.end());
+            qualities.resize(std::min(qualities.size(), static_cast<size_t>(100)));
+            
+            std::cout << "Cavity remeshing test # = " << qualities.size();
+            int remeshed = 0;
+            for (auto& q : qualities)
+            {
+                if (exists(q.second) && remesh_cavity(q.second))
+                {
+                    remeshed++;
+                }
+            }
+            garbage_collect();
+            
+            real new_total, new_object;
+            sum_volumes(new_total, new_object);
+            assert(remeshed > 0);
+            assert(std::abs(new_total - total) <= tolerance*total);
+            assert(std::abs(new_object - object) <= tolerance*object);
+            std::cout << " (" << remeshed << " remeshed) DONE" << std::endl;
+            validity_check();
+        }
+        
+        /**
+         * Deforms a fork and checks that this complex is unchanged, then restarts a copy from a checkpoint and checks that it is valid
+         * and identical to this complex.
+         */
+        void test_fork_and_checkpoint()
+        {
+            std::ostringstream before;
+            save_state(before);
+            
+            std::cout << "Fork test";
+            auto forked = fork();
+            for (auto nit = forked->nodes_begin(); nit != forked->nodes_end(); nit++)
+            {
+                if (nit->is_interface())
+                {
+                    forked->get_mutable(nit.key()).set_destination(nit->get_pos() + 0.5*AVG_LENGTH*forked->get_normal(nit.key()));
+                }
+            }
+            forked->set_verbose(false);
+            forked->deform();
+            
+            std::ostringstream after, deformed;
+            save_state(after);
+            forked->save_state(deformed);
+            assert(before.str() == after.str());
+            assert(before.str() != deformed.str());
+            std::cout << " DONE" << std::endl;
+            forked->validity_check();
+            
+            std::cout << "Checkpoint test";
+            std::istringstream is(before.str());
+            DeformableSimplicialComplex restarted(is);
+            assert(is);
+            
+            std::ostringstream restored;
+            restarted.save_state(restored);
+            assert(before.str() == restored.str());
+            std::cout << " DONE" << std::endl;
+            restarted.validity_check();
+        }
+        
     };
     
 }
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <memory>
 #include "util.h"
 
 namespace DSC {
@@ -65,7 +66,8 @@ namespace DSC {
     
     class MultipleGeometry : public Geometry
     {
-        std::vector<Geometry*> geometries;
+        // Shared, such that a copy (for example a fork of the simplicial complex) uses the same geometries.
+        std::vector<std::shared_ptr<Geometry>> geometries;
         
     public:
         MultipleGeometry()
@@ -73,21 +75,17 @@ namespace DSC {
             
         }
         
-        ~MultipleGeometry()
-        {
-            for (Geometry* g : geometries) {
-                delete g;
-            }
-        }
-        
+        /**
+         Adds a geometry. The geometry is deleted when this and all copies of this are destroyed.
+         */
         void add_geometry(Geometry* geometry)
         {
-            geometries.push_back(geometry);
+            geometries.push_back(std::shared_ptr<Geometry>(geometry));
         }
         
         virtual bool is_inside(vec3 p) const
         {
-            for (Geometry* geometry : geometries)
+            for (auto& geometry : geometries)
             {
                 if(!geometry->is_inside(p))
                 {
@@ -99,7 +97,7 @@ namespace DSC {
         
         virtual void clamp_vector(const vec3& p, vec3& v) const
         {
-            for (Geometry* geometry : geometries)
+            for (auto& geometry : geometries)
             {
                 geometry->clamp_vector(p, v);
             }
@@ -109,7 +107,7 @@ namespace DSC {
         {
             vec3 proj_p;
             real dist = INFINITY;
-            for (Geometry* geometry : geometries)
+            for (auto& geometry : geometries)
             {
                 vec3 pp = geometry->project(p);
                 if(sqr_length(pp - p) < dist)
@@ -0,0 +1,76 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include <chrono>
+#include "util.h"
+
+namespace DSC {
+    
+    /**
+     The metrics of one operation of deform, for example smoothing or thinning, accumulated since the metrics were last reset.
+     The candidates are the simplices selected by the thresholds of the operation. A candidate is skipped if it is removed, fixed or not editable
+     when it is reached, and otherwise it is attempted. An attempt either succeeds, is rejected because the operation fails or does not improve
+     the quality, or falls back to another operation (a split). The metrics are only collected if DSC_METRICS is defined.
+     */
+    struct OperationMetrics
+    {
+        int calls = 0;
+        real time = 0.; // Seconds
+        
+        int candidates = 0;
+        int attempts = 0;
+        int successes = 0;
+        
+        int skipped = 0;
+        int rejected = 0;
+        int fallbacks = 0;
+        
+        void record(int candidates_, int attempts_, int successes_, int fallbacks_ = 0)
+        {
+            candidates += candidates_;
+            attempts += attempts_;
+            successes += successes_;
+            skipped += candidates_ - attempts_;
+            rejected += attempts_ - successes_ - fallbacks_;
+            fallbacks += fallbacks_;
+        }
+    };
+    
+    /**
+     Adds the time from construction to destruction to the time of the metrics and counts the call.
+     */
+    class ScopedTimer
+    {
+        OperationMetrics& metrics;
+        std::chrono::steady_clock::time_point start;
+    
+    public:
+        ScopedTimer(OperationMetrics& metrics_) : metrics(metrics_), start(std::chrono::steady_clock::now())
+        {
+            
+        }
+        
+        ~ScopedTimer()
+        {
+            std::chrono::duration<real> t = std::chrono::steady_clock::now() - start;
+            metrics.time += t.count();
+            metrics.calls++;
+        }
+    };
+    
+}
@@ -0,0 +1,100 @@
+//
+//  Deformabel Simplicial Complex (DSC) method
+//  Copyright (C) 2013  Technical University of Denmark
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  See licence.txt for a copy of the GNU General Public License.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "util.h"
+
+namespace DSC {
+    
+    /**
+     A sizing field which is sampled on a regular grid and trilinearly interpolated between the samples. Points outside the grid get the value
+     of the closest point on the grid. It can be passed to DeformableSimplicialComplex::set_sizing_field, for example to cache a sizing field
+     which is expensive to evaluate.
+     */
+    class SizingGrid
+    {
+        vec3 origin;
+        real spacing;
+        int dims[3];
+        std::vector<real> values;
+    
+    public:
+        /**
+         Creates a grid with dim_x x dim_y x dim_z samples with the given spacing starting at origin. The samples are stored with x varying fastest.
+         */
+        SizingGrid(const vec3& origin_, real spacing_, int dim_x, int dim_y, int dim_z, const std::vector<real>& values_)
+            : origin(origin_), spacing(spacing_), dims{dim_x, dim_y, dim_z}, values(values_)
+        {
+#ifdef DEBUG
+            assert(dim_x > 0 && dim_y > 0 && dim_z > 0);
+            assert(values.size() == static_cast<size_t>(dim_x*dim_y*dim_z));
+#endif
+        }
+        
+        /**
+         Creates a grid by sampling the function f at each grid point.
+         */
+        SizingGrid(const vec3& origin_, real spacing_, int dim_x, int dim_y, int dim_z, const std::function<real(const vec3&)>& f)
+            : origin(origin_), spacing(spacing_), dims{dim_x, dim_y, dim_z}, values(dim_x*dim_y*dim_z)
+        {
+            for (int k = 0; k < dims[2]; k++)
+            {
+                for (int j = 0; j < dims[1]; j++)
+                {
+                    for (int i = 0; i < dims[0]; i++)
+                    {
+                        values[index(i, j, k)] = f(origin + spacing*vec3(static_cast<real>(i), static_cast<real>(j), static_cast<real>(k)));
+                    }
+                }
+            }
+        }
+        
+        real operator()(const vec3& p) const
+        {
+            int i[3];
+            real t[3];
+            for (int d = 0; d < 3; d++)
+            {
+                real x = Util::min(Util::max((p[d] - origin[d])/spacing, 0.), dims[d] - 1);
+                i[d] = std::min(static_cast<int>(x), std::max(dims[d] - 2, 0));
+                t[d] = x - i[d];
+            }
+            
+            real v = 0.;
+            for (int c = 0; c < 8; c++)
+            {
+                int a = c & 1, b = (c >> 1) & 1, e = (c >> 2) & 1;
+                real w = (a ? t[0] : 1. - t[0]) * (b ? t[1] : 1. - t[1]) * (e ? t[2] : 1. - t[2]);
+                if (w > 0.)
+                {
+                    v += w * values[index(i[0] + a, i[1] + b, i[2] + e)];
+                }
+            }
+            return v;
+        }
+    
+    private:
+        size_t index(int i, int j, int k) const
+        {
+            return (static_cast<size_t>(k)*dims[1] + j)*dims[0] + i;
+        }
+    };
+    
+}
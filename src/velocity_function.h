@@ -132,6 +132,45 @@ namespace DSC {
             return total_compute_time;
         }
         
+        /**
+         Writes the state of the velocity function to a binary stream: the time step, the timings, the velocity, the accuracy and the interface positions used by the stopping criterion. A velocity function with additional state should extend this and load_state.
+         */
+        virtual void save_state(std::ostream& os) const
+        {
+            int steps[] = {time_step, MAX_TIME_STEPS};
+            Util::write_binary(os, steps);
+            real values[] = {compute_time, deform_time, total_compute_time, total_deform_time, VELOCITY, ACCURACY};
+            Util::write_binary(os, values);
+            Util::write_binary(os, pos_old);
+        }
+        
+        /**
+         Restores the state written by save_state. Returns false and leaves the state unchanged if the stream could not be read.
+         */
+        virtual bool load_state(std::istream& is)
+        {
+            int steps[2];
+            real values[6];
+            std::vector<vec3> pos;
+            Util::read_binary(is, steps);
+            Util::read_binary(is, values);
+            Util::read_binary(is, pos);
+            if (!is)
+            {
+                return false;
+            }
+            time_step = steps[0];
+            MAX_TIME_STEPS = steps[1];
+            compute_time = values[0];
+            deform_time = values[1];
+            total_compute_time = values[2];
+            total_deform_time = values[3];
+            set_velocity(values[4]);
+            set_accuracy(values[5]);
+            pos_old = pos;
+            return true;
+        }
+    
     protected:
         /**
          Updates the time it took to compute new positions for the interface vertices.
@@ -139,6 +178,7 @@ namespace DSC {
         void update_compute_time(const std::chrono::time_point<std::chrono::system_clock>& start_time)
         {
             std::chrono::duration<real> t = std::chrono::system_clock::now() - start_time;
+            Util::Trace::add("compute velocity", t.count());
             compute_time += t.count();
             total_compute_time += t.count();
         }
@@ -157,6 +197,7 @@ namespace DSC {
          */
         virtual void deform(DeformableSimplicialComplex& dsc)
         {
+            Util::Trace::Scope trace("deform");
             auto init_time = std::chrono::system_clock::now();
             
             dsc.deform();
@@ -202,6 +243,7 @@ namespace DSC {
          */
         void take_time_step(DeformableSimplicialComplex& dsc)
         {
+            Util::Trace::Scope trace("time step");
             compute_time = 0.;
             deform_time = 0.;
             
@@ -217,6 +259,9 @@ namespace DSC {
         {
             dsc.validity_check();
             
+            dsc.test_fork_and_checkpoint();
+            dsc.test_refine();
+            dsc.test_remesh_cavity();
             dsc.test_flip23_flip32();
             dsc.test_split_collapse();
             dsc.test_flip44();